@@ -0,0 +1,628 @@
+#include <string.h>
+#include "MPTRewireAudioKernels.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MPT_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MPT_TARGET_AVX2
+#else
+#define MPT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MPT_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+#define PACK24_SHIFT (MPT_PACK_FRACTIONAL_BITS - 23)
+#define INT24_MAX_VALUE 0x7FFFFF
+#define INT24_MIN_VALUE (-0x800000)
+
+
+
+/*******************************************************************************
+ *
+ * Scalar fallback
+ *
+ ******************************************************************************/
+
+static void DeinterleaveInt32Scalar(const int32_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	for(uint32_t s = 0; s < frames; s++)
+	{
+		*outL++ = static_cast<float>(*src++) * scale;
+		*outR++ = static_cast<float>(*src++) * scale;
+	}
+}
+
+static void DeinterleaveFloat32Scalar(const float *src, float *outL, float *outR, uint32_t frames)
+{
+	for(uint32_t s = 0; s < frames; s++)
+	{
+		*outL++ = *src++;
+		*outR++ = *src++;
+	}
+}
+
+static bool IsSilentScalar(const uint32_t *src, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		if(src[i]) return false;
+	}
+	return true;
+}
+
+static inline int32_t ReadInt24(const uint8_t *p)
+{
+	return static_cast<int32_t>((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+}
+
+static void DeinterleaveInt24Scalar(const uint8_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	for(uint32_t s = 0; s < frames; s++)
+	{
+		*outL++ = static_cast<float>(ReadInt24(src)) * scale;
+		*outR++ = static_cast<float>(ReadInt24(src + 3)) * scale;
+		src += 6;
+	}
+}
+
+static void DeinterleaveInt16Scalar(const int16_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	for(uint32_t s = 0; s < frames; s++)
+	{
+		*outL++ = static_cast<float>(*src++) * scale;
+		*outR++ = static_cast<float>(*src++) * scale;
+	}
+}
+
+// Every sample is read before anything is written over it, which makes packing in place safe
+static void PackInt24Scalar(const int32_t *src, uint8_t *dst, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		int32_t sample = ((*src++ >> (PACK24_SHIFT - 1)) + 1) >> 1;
+		if(sample > INT24_MAX_VALUE) sample = INT24_MAX_VALUE;
+		if(sample < INT24_MIN_VALUE) sample = INT24_MIN_VALUE;
+		*dst++ = (uint8_t)sample;
+		*dst++ = (uint8_t)(sample >> 8);
+		*dst++ = (uint8_t)(sample >> 16);
+	}
+}
+
+// xorshift32: cheap, and easy to run in every lane of a vector
+static inline uint32_t NextDither(uint32_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// The difference of two uniform bytes, i.e. triangular noise of +-1 LSB of the 16-bit output in 24-bit units
+static inline int32_t TriangularDither(uint32_t random)
+{
+	return (int32_t)(random >> 24) - (int32_t)((random >> 16) & 0xFF);
+}
+
+static void PackInt16Scalar(const int32_t *src, uint8_t *dst, size_t count, uint32_t *ditherState)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		int32_t sample = ((*src++ >> PACK24_SHIFT) + TriangularDither(NextDither(ditherState[i % MPT_DITHER_LANES])) + 128) >> 8;
+		if(sample > INT16_MAX) sample = INT16_MAX;
+		if(sample < INT16_MIN) sample = INT16_MIN;
+		const int16_t packed = (int16_t)sample;
+		memcpy(dst, &packed, sizeof(packed));
+		dst += sizeof(packed);
+	}
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * x86: SSE2 & AVX2
+ *
+ ******************************************************************************/
+
+#ifdef MPT_KERNELS_X86
+
+static void DeinterleaveInt32SSE2(const int32_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	const __m128 vScale = _mm_set1_ps(scale);
+	uint32_t s = 0;
+	for(; s + 4 <= frames; s += 4)
+	{
+		// L0 R0 L1 R1 | L2 R2 L3 R3
+		__m128 a = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+		__m128 b = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4)));
+		_mm_storeu_ps(outL, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), vScale));
+		_mm_storeu_ps(outR, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), vScale));
+		src += 8;
+		outL += 4;
+		outR += 4;
+	}
+	DeinterleaveInt32Scalar(src, outL, outR, frames - s, scale);
+}
+
+static void DeinterleaveFloat32SSE2(const float *src, float *outL, float *outR, uint32_t frames)
+{
+	uint32_t s = 0;
+	for(; s + 4 <= frames; s += 4)
+	{
+		__m128 a = _mm_loadu_ps(src);
+		__m128 b = _mm_loadu_ps(src + 4);
+		_mm_storeu_ps(outL, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(outR, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		src += 8;
+		outL += 4;
+		outR += 4;
+	}
+	DeinterleaveFloat32Scalar(src, outL, outR, frames - s);
+}
+
+static bool IsSilentSSE2(const uint32_t *src, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		// Audible blocks usually bail out on the first cache line
+		__m128i acc = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4))),
+			_mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12))));
+		if(0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero))) return false;
+	}
+	return IsSilentScalar(src + i, count - i);
+}
+
+// Four 3-byte samples to sign-extended int32, without reading past the 12 bytes
+static inline __m128i LoadInt24x4SSE2(const uint8_t *src)
+{
+	const __m128i low24 = _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF);
+	const __m128i first = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src));                        // bytes 0-7
+	const __m128i second = _mm_srli_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + 4)), 16);  // bytes 6-11
+	const __m128i pairs = _mm_unpacklo_epi64(first, second);  // a | b << 24 in either half
+	const __m128i v = _mm_or_si128(_mm_and_si128(pairs, low24), _mm_slli_epi64(_mm_and_si128(_mm_srli_epi64(pairs, 24), low24), 32));
+	return _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+}
+
+static void DeinterleaveInt24SSE2(const uint8_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	const __m128 vScale = _mm_set1_ps(scale);
+	uint32_t s = 0;
+	for(; s + 4 <= frames; s += 4)
+	{
+		__m128 a = _mm_cvtepi32_ps(LoadInt24x4SSE2(src));
+		__m128 b = _mm_cvtepi32_ps(LoadInt24x4SSE2(src + 12));
+		_mm_storeu_ps(outL, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), vScale));
+		_mm_storeu_ps(outR, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), vScale));
+		src += 24;
+		outL += 4;
+		outR += 4;
+	}
+	DeinterleaveInt24Scalar(src, outL, outR, frames - s, scale);
+}
+
+static void DeinterleaveInt16SSE2(const int16_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	const __m128 vScale = _mm_set1_ps(scale);
+	uint32_t s = 0;
+	for(; s + 4 <= frames; s += 4)
+	{
+		// Doubling every sample and shifting it back down sign-extends it
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+		__m128 a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+		__m128 b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+		_mm_storeu_ps(outL, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), vScale));
+		_mm_storeu_ps(outR, _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), vScale));
+		src += 8;
+		outL += 4;
+		outR += 4;
+	}
+	DeinterleaveInt16Scalar(src, outL, outR, frames - s, scale);
+}
+
+// Stores go 12 bytes per 16 bytes read, so they never overtake the loads when packing in place
+static void PackInt24SSE2(const int32_t *src, uint8_t *dst, size_t count)
+{
+	const __m128i one = _mm_set1_epi32(1), maxValue = _mm_set1_epi32(INT24_MAX_VALUE), minValue = _mm_set1_epi32(INT24_MIN_VALUE);
+	const __m128i low24 = _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF), high24 = _mm_set_epi32(0xFFFFFF, 0, 0xFFFFFF, 0);
+	size_t i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+		v = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(v, PACK24_SHIFT - 1), one), 1);
+
+		// SSE2 has no 32-bit min and max
+		__m128i clip = _mm_cmpgt_epi32(v, maxValue);
+		v = _mm_or_si128(_mm_andnot_si128(clip, v), _mm_and_si128(clip, maxValue));
+		clip = _mm_cmplt_epi32(v, minValue);
+		v = _mm_or_si128(_mm_andnot_si128(clip, v), _mm_and_si128(clip, minValue));
+
+		// a | b << 24 in either half, then both halves back to back
+		const __m128i pairs = _mm_or_si128(_mm_and_si128(v, low24), _mm_srli_epi64(_mm_and_si128(v, high24), 8));
+		const __m128i packed = _mm_or_si128(_mm_move_epi64(pairs), _mm_slli_si128(_mm_srli_si128(pairs, 8), 6));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst), packed);
+		const int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+		memcpy(dst + 8, &last, sizeof(last));
+		src += 4;
+		dst += 12;
+	}
+	PackInt24Scalar(src, dst, count - i);
+}
+
+static inline __m128i NextDitherSSE2(__m128i state)
+{
+	state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+	state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+	return _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+}
+
+static inline __m128i PackInt16x4SSE2(__m128i v, __m128i random)
+{
+	const __m128i dither = _mm_sub_epi32(_mm_srli_epi32(random, 24), _mm_and_si128(_mm_srli_epi32(random, 16), _mm_set1_epi32(0xFF)));
+	return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_srai_epi32(v, PACK24_SHIFT), dither), _mm_set1_epi32(128)), 8);
+}
+
+static void PackInt16SSE2(const int32_t *src, uint8_t *dst, size_t count, uint32_t *ditherState)
+{
+	// Lanes 0-3 and 4-7 of the noise, for the first and second half of every 8 samples
+	__m128i state0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ditherState));
+	__m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ditherState + 4));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		state0 = NextDitherSSE2(state0);
+		state1 = NextDitherSSE2(state1);
+		__m128i a = PackInt16x4SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), state0);
+		__m128i b = PackInt16x4SSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4)), state1);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_packs_epi32(a, b));  // saturates
+		src += 8;
+		dst += 16;
+	}
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(ditherState), state0);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(ditherState + 4), state1);
+	PackInt16Scalar(src, dst, count - i, ditherState);
+}
+
+
+MPT_TARGET_AVX2 static void DeinterleaveInt32AVX2(const int32_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	const __m256 vScale = _mm256_set1_ps(scale);
+	uint32_t s = 0;
+	for(; s + 8 <= frames; s += 8)
+	{
+		__m256 a = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 8)));
+		// Shuffles work per 128-bit lane, which leaves L0 L1 L4 L5 L2 L3 L6 L7; fix up the order with a permute
+		__m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+		r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(outL, _mm256_mul_ps(l, vScale));
+		_mm256_storeu_ps(outR, _mm256_mul_ps(r, vScale));
+		src += 16;
+		outL += 8;
+		outR += 8;
+	}
+	DeinterleaveInt32SSE2(src, outL, outR, frames - s, scale);
+}
+
+MPT_TARGET_AVX2 static void DeinterleaveFloat32AVX2(const float *src, float *outL, float *outR, uint32_t frames)
+{
+	uint32_t s = 0;
+	for(; s + 8 <= frames; s += 8)
+	{
+		__m256 a = _mm256_loadu_ps(src);
+		__m256 b = _mm256_loadu_ps(src + 8);
+		__m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm256_storeu_ps(outL, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0))));
+		_mm256_storeu_ps(outR, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0))));
+		src += 16;
+		outL += 8;
+		outR += 8;
+	}
+	DeinterleaveFloat32SSE2(src, outL, outR, frames - s);
+}
+
+MPT_TARGET_AVX2 static bool IsSilentAVX2(const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+	for(; i + 32 <= count; i += 32)
+	{
+		__m256i acc = _mm256_or_si256(
+			_mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 8))),
+			_mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 16)), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 24))));
+		if(!_mm256_testz_si256(acc, acc)) return false;
+	}
+	return IsSilentSSE2(src + i, count - i);
+}
+
+MPT_TARGET_AVX2 static void DeinterleaveInt24AVX2(const uint8_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	// Puts every 3-byte sample into the upper bytes of a 32-bit lane, the arithmetic shift then sign-extends it.
+	// The last group is loaded 4 bytes early, so that nothing past the 48 bytes of 8 frames is read.
+	const __m128i expand = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	const __m128i expandLast = _mm_setr_epi8(-1, 4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15);
+	const __m256 vScale = _mm256_set1_ps(scale);
+	uint32_t s = 0;
+	for(; s + 8 <= frames; s += 8)
+	{
+		__m128i g0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), expand);
+		__m128i g1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 12)), expand);
+		__m128i g2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 24)), expand);
+		__m128i g3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32)), expandLast);
+		__m256 a = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_inserti128_si256(_mm256_castsi128_si256(g0), g1, 1), 8));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_inserti128_si256(_mm256_castsi128_si256(g2), g3, 1), 8));
+		__m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+		r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(outL, _mm256_mul_ps(l, vScale));
+		_mm256_storeu_ps(outR, _mm256_mul_ps(r, vScale));
+		src += 48;
+		outL += 8;
+		outR += 8;
+	}
+	DeinterleaveInt24SSE2(src, outL, outR, frames - s, scale);
+}
+
+MPT_TARGET_AVX2 static void DeinterleaveInt16AVX2(const int16_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	const __m256 vScale = _mm256_set1_ps(scale);
+	uint32_t s = 0;
+	for(; s + 8 <= frames; s += 8)
+	{
+		__m256 a = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))));
+		__m256 b = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 8))));
+		__m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		l = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0)));
+		r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm256_storeu_ps(outL, _mm256_mul_ps(l, vScale));
+		_mm256_storeu_ps(outR, _mm256_mul_ps(r, vScale));
+		src += 16;
+		outL += 8;
+		outR += 8;
+	}
+	DeinterleaveInt16SSE2(src, outL, outR, frames - s, scale);
+}
+
+MPT_TARGET_AVX2 static void PackInt24AVX2(const int32_t *src, uint8_t *dst, size_t count)
+{
+	// Drops the top byte of every lane, leaving 12 packed bytes at the bottom of either half
+	const __m256i compact = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i one = _mm256_set1_epi32(1), maxValue = _mm256_set1_epi32(INT24_MAX_VALUE), minValue = _mm256_set1_epi32(INT24_MIN_VALUE);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+		v = _mm256_srai_epi32(_mm256_add_epi32(_mm256_srai_epi32(v, PACK24_SHIFT - 1), one), 1);
+		v = _mm256_shuffle_epi8(_mm256_min_epi32(_mm256_max_epi32(v, minValue), maxValue), compact);
+		const __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+		const int32_t loLast = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8)), hiLast = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst), lo);
+		memcpy(dst + 8, &loLast, sizeof(loLast));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 12), hi);
+		memcpy(dst + 20, &hiLast, sizeof(hiLast));
+		src += 8;
+		dst += 24;
+	}
+	PackInt24Scalar(src, dst, count - i);
+}
+
+MPT_TARGET_AVX2 static void PackInt16AVX2(const int32_t *src, uint8_t *dst, size_t count, uint32_t *ditherState)
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xFF), half = _mm256_set1_epi32(128);
+	__m256i state = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ditherState));
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+		state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+		state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+		const __m256i dither = _mm256_sub_epi32(_mm256_srli_epi32(state, 24), _mm256_and_si256(_mm256_srli_epi32(state, 16), byteMask));
+
+		__m256i v = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), PACK24_SHIFT);
+		v = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(v, dither), half), 8);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+		src += 8;
+		dst += 16;
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(ditherState), state);
+	PackInt16Scalar(src, dst, count - i, ditherState);
+}
+
+
+static bool CpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if(info[0] < 7) return false;
+
+	// The OS must save the YMM registers on context switches
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+	if(!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // MPT_KERNELS_X86
+
+
+
+
+/*******************************************************************************
+ *
+ * ARM: NEON
+ *
+ ******************************************************************************/
+
+#ifdef MPT_KERNELS_NEON
+
+static void DeinterleaveInt32NEON(const int32_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	uint32_t s = 0;
+	for(; s + 4 <= frames; s += 4)
+	{
+		int32x4x2_t lr = vld2q_s32(src);  // deinterleaves on load
+		vst1q_f32(outL, vmulq_n_f32(vcvtq_f32_s32(lr.val[0]), scale));
+		vst1q_f32(outR, vmulq_n_f32(vcvtq_f32_s32(lr.val[1]), scale));
+		src += 8;
+		outL += 4;
+		outR += 4;
+	}
+	DeinterleaveInt32Scalar(src, outL, outR, frames - s, scale);
+}
+
+static void DeinterleaveFloat32NEON(const float *src, float *outL, float *outR, uint32_t frames)
+{
+	uint32_t s = 0;
+	for(; s + 4 <= frames; s += 4)
+	{
+		float32x4x2_t lr = vld2q_f32(src);
+		vst1q_f32(outL, lr.val[0]);
+		vst1q_f32(outR, lr.val[1]);
+		src += 8;
+		outL += 4;
+		outR += 4;
+	}
+	DeinterleaveFloat32Scalar(src, outL, outR, frames - s);
+}
+
+static bool IsSilentNEON(const uint32_t *src, size_t count)
+{
+	size_t i = 0;
+	for(; i + 16 <= count; i += 16)
+	{
+		uint32x4_t acc = vorrq_u32(vorrq_u32(vld1q_u32(src + i), vld1q_u32(src + i + 4)), vorrq_u32(vld1q_u32(src + i + 8), vld1q_u32(src + i + 12)));
+		uint32x2_t folded = vorr_u32(vget_low_u32(acc), vget_high_u32(acc));
+		if(vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) return false;
+	}
+	return IsSilentScalar(src + i, count - i);
+}
+
+static void DeinterleaveInt16NEON(const int16_t *src, float *outL, float *outR, uint32_t frames, float scale)
+{
+	uint32_t s = 0;
+	for(; s + 8 <= frames; s += 8)
+	{
+		int16x8x2_t lr = vld2q_s16(src);
+		vst1q_f32(outL, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lr.val[0]))), scale));
+		vst1q_f32(outL + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lr.val[0]))), scale));
+		vst1q_f32(outR, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lr.val[1]))), scale));
+		vst1q_f32(outR + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lr.val[1]))), scale));
+		src += 16;
+		outL += 8;
+		outR += 8;
+	}
+	DeinterleaveInt16Scalar(src, outL, outR, frames - s, scale);
+}
+
+static inline uint32x4_t NextDitherNEON(uint32x4_t state)
+{
+	state = veorq_u32(state, vshlq_n_u32(state, 13));
+	state = veorq_u32(state, vshrq_n_u32(state, 17));
+	return veorq_u32(state, vshlq_n_u32(state, 5));
+}
+
+static inline int16x4_t PackInt16x4NEON(int32x4_t v, uint32x4_t random)
+{
+	const int32x4_t dither = vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(random, 24)), vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(random, 16), vdupq_n_u32(0xFF))));
+	return vqmovn_s32(vshrq_n_s32(vaddq_s32(vaddq_s32(vshrq_n_s32(v, PACK24_SHIFT), dither), vdupq_n_s32(128)), 8));
+}
+
+static void PackInt16NEON(const int32_t *src, uint8_t *dst, size_t count, uint32_t *ditherState)
+{
+	uint32x4_t state0 = vld1q_u32(ditherState), state1 = vld1q_u32(ditherState + 4);
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		state0 = NextDitherNEON(state0);
+		state1 = NextDitherNEON(state1);
+		int32x4_t a = vld1q_s32(src), b = vld1q_s32(src + 4);
+		vst1q_u8(dst, vreinterpretq_u8_s16(vcombine_s16(PackInt16x4NEON(a, state0), PackInt16x4NEON(b, state1))));
+		src += 8;
+		dst += 16;
+	}
+	vst1q_u32(ditherState, state0);
+	vst1q_u32(ditherState + 4, state1);
+	PackInt16Scalar(src, dst, count - i, ditherState);
+}
+
+#endif // MPT_KERNELS_NEON
+
+
+
+
+/*******************************************************************************
+ *
+ * Dispatch
+ *
+ ******************************************************************************/
+
+static const MPTAudioKernels g_ScalarKernels = { "Scalar", DeinterleaveInt32Scalar, DeinterleaveFloat32Scalar, IsSilentScalar,
+	DeinterleaveInt24Scalar, DeinterleaveInt16Scalar, PackInt24Scalar, PackInt16Scalar };
+#ifdef MPT_KERNELS_X86
+static const MPTAudioKernels g_SSE2Kernels = { "SSE2", DeinterleaveInt32SSE2, DeinterleaveFloat32SSE2, IsSilentSSE2,
+	DeinterleaveInt24SSE2, DeinterleaveInt16SSE2, PackInt24SSE2, PackInt16SSE2 };
+static const MPTAudioKernels g_AVX2Kernels = { "AVX2", DeinterleaveInt32AVX2, DeinterleaveFloat32AVX2, IsSilentAVX2,
+	DeinterleaveInt24AVX2, DeinterleaveInt16AVX2, PackInt24AVX2, PackInt16AVX2 };
+#endif
+#ifdef MPT_KERNELS_NEON
+// 24-bit samples stay scalar, vld3/vst3 only split bytes and the reassembly eats up the gain
+static const MPTAudioKernels g_NEONKernels = { "NEON", DeinterleaveInt32NEON, DeinterleaveFloat32NEON, IsSilentNEON,
+	DeinterleaveInt24Scalar, DeinterleaveInt16NEON, PackInt24Scalar, PackInt16NEON };
+#endif
+
+
+static const MPTAudioKernels &SelectAudioKernels()
+{
+#if defined(MPT_KERNELS_X86)
+	return CpuHasAVX2() ? g_AVX2Kernels : g_SSE2Kernels;
+#elif defined(MPT_KERNELS_NEON)
+	return g_NEONKernels;
+#else
+	return g_ScalarKernels;
+#endif
+}
+
+const MPTAudioKernels &MPTGetAudioKernels()
+{
+	static const MPTAudioKernels &kernels = SelectAudioKernels();
+	return kernels;
+}
+
+const MPTAudioKernels &MPTGetScalarAudioKernels()
+{
+	return g_ScalarKernels;
+}
+
+int MPTGetAvailableAudioKernels(const MPTAudioKernels **kernels, int maxCount)
+{
+	const MPTAudioKernels *available[3];
+	int count = 0;
+	available[count++] = &g_ScalarKernels;
+#if defined(MPT_KERNELS_X86)
+	available[count++] = &g_SSE2Kernels;
+	if(CpuHasAVX2()) available[count++] = &g_AVX2Kernels;
+#elif defined(MPT_KERNELS_NEON)
+	available[count++] = &g_NEONKernels;
+#endif
+	if(count > maxCount) count = maxCount;
+	for(int i = 0; i < count; i++) kernels[i] = available[i];
+	return count;
+}
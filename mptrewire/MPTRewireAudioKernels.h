@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversion kernels for the real-time audio path.
+// The best implementation for the running CPU is picked once, the first time the table is requested.
+
+typedef void (*MPTDeinterleaveInt32Func)(const int32_t *src, float *outL, float *outR, uint32_t frames, float scale);
+typedef void (*MPTDeinterleaveFloat32Func)(const float *src, float *outL, float *outR, uint32_t frames);
+typedef bool (*MPTIsSilentFunc)(const uint32_t *src, size_t count);
+typedef void (*MPTDeinterleaveInt24Func)(const uint8_t *src, float *outL, float *outR, uint32_t frames, float scale);
+typedef void (*MPTDeinterleaveInt16Func)(const int16_t *src, float *outL, float *outR, uint32_t frames, float scale);
+typedef void (*MPTPackInt24Func)(const int32_t *src, uint8_t *dst, size_t count);
+typedef void (*MPTPackInt16Func)(const int32_t *src, uint8_t *dst, size_t count, uint32_t *ditherState);
+
+// The packed formats start out from int32 fixed point with this many fractional bits, i.e. MIXING_SCALEF
+#define MPT_PACK_FRACTIONAL_BITS 27
+// and they reach full scale at
+#define MPT_INT24_SCALEF 8388608.0f
+#define MPT_INT16_SCALEF 32768.0f
+
+#define MPT_DITHER_LANES 8  // packInt16 runs this many independent noise generators, sample i uses lane i % 8
+
+typedef struct
+{
+	const char *name;  // "AVX2", "SSE2", "NEON" or "Scalar"
+
+	// Converts interleaved stereo int32 to two planar float buffers, multiplying every sample by scale.
+	// Bit-exact with static_cast<float>(sample) / (1.0f / scale) as long as scale is a power of two.
+	MPTDeinterleaveInt32Func deinterleaveInt32;
+
+	// Splits interleaved stereo float into two planar buffers without touching the sample values
+	MPTDeinterleaveFloat32Func deinterleaveFloat32;
+
+	// True if every 32-bit sample is zero, i.e. digital silence in both the int32 and float32 format
+	MPTIsSilentFunc isSilent;
+
+	// Like deinterleaveInt32, for interleaved stereo packed as 3-byte little-endian and as int16 samples
+	MPTDeinterleaveInt24Func deinterleaveInt24;
+	MPTDeinterleaveInt16Func deinterleaveInt16;
+
+	// Convert count int32 samples to 24-bit (rounded) or 16-bit (with triangular dither of +-1 LSB), saturating.
+	// dst may be the same memory as src, the samples are then packed in place. ditherState holds
+	// MPT_DITHER_LANES nonzero words that carry the noise over from one call to the next.
+	// All implementations produce the same bytes, dither included.
+	MPTPackInt24Func packInt24;
+	MPTPackInt16Func packInt16;
+} MPTAudioKernels;
+
+const MPTAudioKernels &MPTGetAudioKernels();
+const MPTAudioKernels &MPTGetScalarAudioKernels();
+// Every implementation the running CPU can execute, the scalar one first, for tests and benchmarks. Returns how many.
+int MPTGetAvailableAudioKernels(const MPTAudioKernels **kernels, int maxCount);
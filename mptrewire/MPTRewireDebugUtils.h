@@ -7,7 +7,7 @@
 #include <chrono>
 
 // Logging function
-#define DEBUG_PRINT(format, ...) fprintf(stderr, format, __VA_ARGS__)
+#define DEBUG_PRINT(...) fprintf(stderr, __VA_ARGS__)
 
 
 
@@ -25,8 +25,8 @@
 #define MIXING_SCALEF 134217728.0f
 #endif
 
-int g_DummyDataIndexInt   = 0;
-int g_DummyDataIndexFloat = 0;
+inline int g_DummyDataIndexInt   = 0;
+inline int g_DummyDataIndexFloat = 0;
 
 static void FillWithDummyAudioDataInt32(int32_t *channel, uint16_t framesToRender, int sampleRate) {
 	for(int32_t *p = channel; p < &channel[framesToRender * 2];) {
@@ -76,8 +76,8 @@ static bool CompareBitFields(const uint32_t *bitfieldA, const uint32_t *bitfield
  * Profiling
  * 
  ******************************************************************************/
-LARGE_INTEGER g_DebugPerfFreq, g_DebugTicksNow, g_DebugTicksStart;
-double g_DebugDiffMs;
+inline LARGE_INTEGER g_DebugPerfFreq, g_DebugTicksNow, g_DebugTicksStart;
+inline double g_DebugDiffMs;
 
 #define DEBUG_PROFILING_START()\
 	{\
@@ -88,7 +88,7 @@ double g_DebugDiffMs;
 	{\
 		QueryPerformanceCounter(&g_DebugTicksNow);\
 		QueryPerformanceFrequency(&g_DebugPerfFreq);\
-		g_DebugDiffMs = (g_DebugTicksNow.QuadPart - g_DebugTicksStart.QuadPart) / (g_PerfFrequency.QuadPart / 1000.0);\
+		g_DebugDiffMs = (g_DebugTicksNow.QuadPart - g_DebugTicksStart.QuadPart) / (g_DebugPerfFreq.QuadPart / 1000.0);\
 		DEBUG_PRINT(\
 			"Profiling took %f ms.\n",\
 			g_DebugDiffMs\
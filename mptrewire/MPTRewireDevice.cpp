@@ -5,6 +5,12 @@
 #include <ReWireDeviceAPI.h>
 #include <RWDEFAPI.h>
 #include "MPTRewirePanel.h"
+#include "MPTRewireSharedMemory.h"
+#include "MPTRewireAudioKernels.h"
+#include "MPTRewireMemory.h"
+#include "MPTRewireRouting.h"
+#include "MPTRewireStats.h"
+#include "MPTRewireWait.h"
 #include "MPTRewireDebugUtils.h"
 
 
@@ -14,24 +20,87 @@ using namespace ReWire;
 #ifndef MIXING_SCALEF
 #define MIXING_SCALEF 134217728.0f
 #endif
-#define PIPE_SIZE_EVENTS 32
-#define PIPE_SIZE_RT  (8192 * 2 * sizeof(int32_t)) // realtime audio thread
+#define PIPE_SIZE_EVENTS 1024 // room for a burst of timestamped events
+#define OFFLINE_WINDOW_MS     250   // wall-clock time the mixer's speed is averaged over
+#define OFFLINE_ENTER_WINDOWS 2     // windows in a row at more than twice real-time speed before we call it a bounce
+#define OFFLINE_MAX_WAIT_MS  10000  // a bounce waits this long for a block before giving up on it
 
 
 LARGE_INTEGER g_PerfFrequency;  // for QueryPerformanceCounter
+HINSTANCE g_Module = NULL;
+MPTRoutingMap g_Routing;                     // loaded once, the mixer only asks for our channels once
+bool g_RoutingLoaded = false;
+uint32_t g_BusCount = 0;                     // stereo channels we advertise, g_Routing.busCount
 TRWDPortHandle g_DevicePortHandle = 0;
 ReWireAudioInfo g_AudioInfo = { 0 };
-uint8_t g_IncomingData[PIPE_SIZE_RT];
-uint8_t g_IncomingEvent[PIPE_SIZE_EVENTS];
+MPTLockedBuffer g_DeviceMemory;              // everything below that the mixer's audio thread touches in bulk
+uint8_t* g_IncomingData = nullptr;           // PIPE_SIZE_RT bytes
+uint8_t* g_IncomingEvent = nullptr;          // PIPE_SIZE_EVENTS bytes
 HANDLE g_EventToPanel = NULL;
 HANDLE g_EventFromPanel = NULL;
+MPTHybridEvent g_SignalToPanel;    // wraps g_EventToPanel
+MPTHybridEvent g_SignalFromPanel;  // wraps g_EventFromPanel
+MPTSharedControl g_Control;                  // settings, statistics, signals and credits shared with the panel
+MPTSharedAudioRing g_AudioRing;              // only once the panel asks for it, see CreateAudioRing()
+std::atomic<bool> g_AudioRingReady{false};   // g_AudioRing may be used on the mixer's audio thread
+bool g_AudioRingFailed = false;              // could not be created, not tried again until the device is reopened
+const MPTAudioKernels* g_Kernels = &MPTGetScalarAudioKernels();
+uint32_t g_RequestSequence = 0;
+uint32_t g_RenderAhead = 0;                  // depth the pipeline currently runs at, see MPT_MAX_RENDER_AHEAD
+uint32_t g_OutstandingBlocks = 0;            // requests sent in render-ahead mode that were not played yet
+uint32_t g_RenderAheadFramesToRender = 0;    // block size of the outstanding requests
+uint32_t g_Credits = 0;                      // granted with the last request, see MPT_CAP_CREDITS
+bool g_UsingCredits = false;                 // the panel sends the current block by them
+uint32_t g_RenderQuantum = 0;                // frames per request while callbacks are served from the quantum FIFO, 0 if not
+float* g_QuantumBuffers[kReWireAudioChannelCount] = { 0 };  // MPT_MAX_RENDER_QUANTUM frames each for 2 * g_BusCount, what the panel's block is uploaded to instead of the mixer
+ReWire_uint32_t g_QuantumServedChannels[REWIRE_BITFIELD_SIZE(kReWireAudioChannelCount)];
+uint32_t g_QuantumFrames = 0;                // frames of the block in the FIFO, 0 if it is empty
+uint32_t g_QuantumReadPosition = 0;          // frames of it the mixer got already
+uint32_t g_QuantumRenderPosition = 0;        // panel render position of its first frame
+bool g_Offline = false;                      // the mixer bounces, see UpdateOfflineDetection()
+uint32_t g_OfflineStreak = 0;                // windows in a row at bounce speed
+uint64_t g_OfflineWindowStartNs = 0;         // 0: no window started yet
+uint64_t g_OfflineWindowFrames = 0;          // the mixer asked for since the window started
+float* g_ZeroedBuffers[kReWireAudioChannelCount] = { 0 };  // mixer buffers we left zeroed, nullptr once we wrote to them
+uint32_t g_ZeroedFramesToRender = 0;                       // block size g_ZeroedBuffers is valid for
+uint64_t g_ChannelsZeroed = 0;
+uint64_t g_ChannelsZeroingAvoided = 0;
+uint64_t g_BytesZeroingAvoided = 0;
+MPTDeviceTiming g_LocalTiming;                   // used while there is no shared region
+MPTDeviceTiming* g_Timing = &g_LocalTiming;
+uint64_t g_RequestSentNs = 0;                    // 0 if the current callback has not requested anything yet
+uint64_t g_HeaderReceivedNs = 0;
+uint64_t g_LastCallbackNs = 0;
+bool g_SpinWaitEnabled = true;
 bool g_ReWireOpen = false;
+
+// An event read from PIPE_EVENTS that waits for the block it was timestamped for
+typedef struct
+{
+	uint8_t type;
+	uint32_t framePosition;  // in the panel's render position
+	uint32_t value;          // tempo or position15360PPQ, depending on type
+} PendingEvent;
+#define MAX_PENDING_EVENTS 64
+#define MAX_EVENT_OUTPUT 512  // events we hand the mixer per block at most, see RWDEFGetDeviceInfo()
+PendingEvent g_PendingEvents[MAX_PENDING_EVENTS];
+int g_PendingEventCount = 0;
+uint32_t g_LastPanelBlockEnd = 0;  // render position after the last block events were handled for
+bool g_PanelBlockEndKnown = false;
 #ifdef DEBUG
-int g_LastFramesToRender = 0;
+ReWire_uint32_t g_LastFramesToRender = 0;
 #endif
 
 
-static void PollAndHandleEvents(ReWireDriveAudioOutputParams *outputParams);
+static void PollAndHandleEvents(const ReWireDriveAudioInputParams *inputParams, ReWireDriveAudioOutputParams *outputParams, uint32_t panelBlockEnd);
+static void ForgetPanelSession();
+static int32_t FramesToPPQ15360(int32_t frames, uint32_t tempo);
+static void LoadRouting();
+static bool AllocateDeviceMemory();
+static void PublishLockedMemoryStats();
+static void PublishMaxBufferSize();
+static void CreateAudioRing();
+static void CloseCommunication();
 
 
 
@@ -43,9 +112,24 @@ static void PollAndHandleEvents(ReWireDriveAudioOutputParams *outputParams);
  ******************************************************************************/
 
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpReserved) {
+    if (DLL_PROCESS_ATTACH == fdwReason) g_Module = hinstDLL;
     return TRUE;
 }
 
+// The map file sits next to us; without one every OpenMPT channel and plugin gets a ReWire channel of its own
+static void LoadRouting() {
+    if (g_RoutingLoaded) return;
+    char moduleFileName[MAX_PATH] = { 0 };
+    char path[MAX_PATH + sizeof(MPT_ROUTING_MAP_FILE)];
+    GetModuleFileNameA(g_Module, moduleFileName, MAX_PATH);
+    MPTRoutingMapPath(moduleFileName, path, sizeof(path));
+    MPTDefaultRoutingMap(g_Routing);
+    if (MPTLoadRoutingMap(path, g_Routing))
+        DEBUG_PRINT("DEVICE: Routing %i buses from %s.\n", (int)g_Routing.busCount, path);
+    g_BusCount = g_Routing.busCount;
+    g_RoutingLoaded = true;
+}
+
 void RWDEFGetDeviceNameAndVersion(ReWire_int32_t* codedForReWireVersion, ReWire_char_t* name) {
 	*codedForReWireVersion = REWIRE_DEVICE_DLL_API_VERSION;
 	strcpy(name, "OpenMPT");
@@ -54,23 +138,21 @@ void RWDEFGetDeviceNameAndVersion(ReWire_int32_t* codedForReWireVersion, ReWire_
 void RWDEFGetDeviceInfo(ReWireDeviceInfo* info) {
 
 	RWDEFGetDeviceNameAndVersion(&info->fCodedForReWireVersion, info->fName);
-	info->fChannelCount = kReWireAudioChannelCount;
+    LoadRouting();
+	info->fChannelCount = 2 * g_BusCount;
 
-    // Name channels
-    for (uint16_t i = 0; i < kReWireAudioChannelCount / 2; i++)
-        sprintf(info->fChannelNames[i], "Channel %i", (int)i / 2 + 1);
-    for (uint16_t i = kReWireAudioChannelCount / 2; i < kReWireAudioChannelCount - 2; i++)
-        sprintf(info->fChannelNames[i], "Plugin %i", (int)i / 2 - 63);
-	const char strPreviewChannel[] = "Preview";
-	strcpy(info->fChannelNames[126], strPreviewChannel);
-	strcpy(info->fChannelNames[127], strPreviewChannel);
+    // Name channels after their buses, both halves of a stereo pair alike
+    for (uint16_t i = 0; i < 2 * g_BusCount; i++) {
+        strncpy(info->fChannelNames[i], g_Routing.busNames[i / 2], sizeof(info->fChannelNames[i]) - 1);
+        info->fChannelNames[i][sizeof(info->fChannelNames[i]) - 1] = '\0';
+    }
 
     // Mark all channels as stereo
-    for (uint16_t i = 0; i < kReWireAudioChannelCount / 2; i++) {
+    for (uint16_t i = 0; i < g_BusCount; i++) {
         ReWireSetBitInBitField(info->fStereoPairsBitField, i);
     }
 
-	info->fMaxEventOutputBufferSize = 512;
+	info->fMaxEventOutputBufferSize = MAX_EVENT_OUTPUT;
 }
 
 ReWireError RWDEFOpenDevice(const ReWireOpenInfo* openInfo) {
@@ -104,8 +186,42 @@ ReWireError RWDEFOpenDevice(const ReWireOpenInfo* openInfo) {
     g_AudioInfo = openInfo->fAudioInfo;
     DEBUG_PRINT("DEVICE: RWDEFOpenDevice: fSampleRate = %i, fMaxBufferSize = %i.\n", g_AudioInfo.fSampleRate, g_AudioInfo.fMaxBufferSize);
 
+    // Events of a previous session have nothing to do with the new panel's timeline
+    ForgetPanelSession();
+    g_OutstandingBlocks = 0;
+    g_Offline = false;
+    g_OfflineStreak = 0;
+    g_OfflineWindowStartNs = 0;
+
     // Open / create inter-process events
     g_EventToPanel = CreateEventA(NULL, FALSE, FALSE, "OPENMPT_REWIRE_DEVICE_TO_PANEL");
+    g_SignalToPanel.setEvent(g_EventToPanel);
+
+    // Create the shared control region, which tells the panel which buses we advertised; without it we stick to
+    // the COM pipe and its handshakes. The audio ring follows once the panel asks for it, see CreateAudioRing().
+    // Both survive RestartDevice() because the panel could still have them mapped.
+    LoadRouting();
+    if (!g_Control.isOpen() && !g_Control.create(MPT_SHARED_CONTROL_NAME, g_Routing)) {
+        DEBUG_PRINT("DEVICE: Unable to create shared control region, error=%i.\n", (int)GetLastError());
+    }
+    g_Timing = g_Control.isOpen() ? &g_Control.header()->deviceTiming : &g_LocalTiming;
+    g_LastCallbackNs = 0;
+    PublishMaxBufferSize();
+
+    // Lock what we receive into up front, a page fault on the mixer's audio thread costs more than the whole block.
+    // Like the ring it survives RestartDevice().
+    if (!g_DeviceMemory.data()) {
+        if (!AllocateDeviceMemory()) {
+            CloseCommunication();
+            return kReWireError_UnableToOpenDevice;
+        }
+        if (!g_DeviceMemory.isLocked()) DEBUG_PRINT("DEVICE: Unable to lock %i bytes of audio buffers into memory.\n", (int)g_DeviceMemory.size());
+    }
+    PublishLockedMemoryStats();
+
+    // Pick the conversion kernels for this CPU now rather than on the mixer's audio thread
+    g_Kernels = &MPTGetAudioKernels();
+    DEBUG_PRINT("DEVICE: Using %s audio kernels.\n", g_Kernels->name);
 
     QueryPerformanceFrequency(&g_PerfFrequency); // for QueryPerformanceCounter
 	return kReWireError_NoError;
@@ -116,13 +232,93 @@ ReWire_char_t RWDEFIsCloseOK() {
 	return 1;
 }
 
-void RWDEFCloseDevice() {
+static bool AllocateDeviceMemory() {
+    const size_t quantumSize = sizeof(float) * MPT_MAX_RENDER_QUANTUM;
+    if (!g_DeviceMemory.allocate(PIPE_SIZE_RT + PIPE_SIZE_EVENTS + 2 * g_BusCount * quantumSize)) return false;
+    g_IncomingData = g_DeviceMemory.data();
+    g_IncomingEvent = g_IncomingData + PIPE_SIZE_RT;
+    for (uint32_t i = 0; i < 2 * g_BusCount; i++)
+        g_QuantumBuffers[i] = reinterpret_cast<float*>(g_IncomingEvent + PIPE_SIZE_EVENTS + i * quantumSize);
+    return true;
+}
+
+static void FreeDeviceMemory() {
+    g_DeviceMemory.free();
+    g_IncomingData = g_IncomingEvent = nullptr;
+    for (int i = 0; i < kReWireAudioChannelCount; i++)
+        g_QuantumBuffers[i] = nullptr;
+}
+
+static void PublishLockedMemoryStats() {
+    if (!g_Control.isOpen()) return;
+    MPTLockedMemoryStats stats;
+    MPTGetLockedMemoryStats(stats);
+    g_Control.header()->lockedMemoryBytes.store(stats.lockedBytes, std::memory_order_relaxed);
+    g_Control.header()->unlockedMemoryBytes.store(stats.unlockedBytes, std::memory_order_relaxed);
+    g_Control.header()->hugePageBytes.store(stats.hugePageBytes, std::memory_order_relaxed);
+}
+
+// Lets the panel size its buffers before the first block rather than in response to it
+static void PublishMaxBufferSize() {
+    if (!g_Control.isOpen()) return;
+    g_Control.header()->maxBufferSize.store(g_AudioInfo.fMaxBufferSize > 0 ? (uint32_t)g_AudioInfo.fMaxBufferSize : 0, std::memory_order_relaxed);
+}
+
+/**
+ * The panel renders into the audio ring on its audio thread and we read from it on ours, so it is only worth its
+ * memory once the panel asks for the shared-memory transport. It is created here on the mixer's idle thread,
+ * never on its audio thread, and published to the audio thread through g_AudioRingReady. From then on it stays
+ * until the device is closed: the audio thread may be reading a slot at any time.
+ * Its slots hold one channel for each of our buses and the largest block the panel renders, i.e. the mixer's
+ * maximum buffer size or the render quantum. Should the mixer grow its blocks later, those take the COM pipe.
+**/
+static void CreateAudioRing() {
+    if (g_AudioRingReady.load(std::memory_order_relaxed) || g_AudioRingFailed || !g_Control.isOpen()) return;
+    if (!g_Control.header()->audioRingRequested.load(std::memory_order_relaxed)) return;
+
+    uint32_t maxFrames = (g_AudioInfo.fMaxBufferSize > 0) ? (uint32_t)g_AudioInfo.fMaxBufferSize : MPT_SHARED_RING_MAX_FRAMES;
+    const uint32_t quantum = g_Control.header()->requestedRenderQuantum.load(std::memory_order_relaxed);
+    if (quantum > maxFrames) maxFrames = quantum;
+    if (maxFrames > MPT_SHARED_RING_MAX_FRAMES) maxFrames = MPT_SHARED_RING_MAX_FRAMES;
+    if (!g_AudioRing.create(MPT_SHARED_RING_NAME, g_BusCount, maxFrames)) {
+        DEBUG_PRINT("DEVICE: Unable to create shared audio ring, error=%i.\n", (int)GetLastError());
+        g_AudioRingFailed = true;
+        return;
+    }
+    g_AudioRingReady.store(true, std::memory_order_release);
+    g_Control.header()->audioRingReady.store(1, std::memory_order_release);
+    PublishLockedMemoryStats();
+}
+
+// Only on the audio thread
+static bool IsAudioRingReady() {
+    return g_AudioRingReady.load(std::memory_order_acquire);
+}
+
+static bool DoesBlockFitAudioRing(uint32_t framesToRender) {
+    return IsAudioRingReady() && framesToRender <= g_AudioRing.maxFrames();
+}
+
+static void CloseCommunication() {
     if (g_DevicePortHandle) RWDComDestroy(g_DevicePortHandle);
     CloseHandle(g_EventToPanel);
+    g_SignalToPanel.setSignal(nullptr);
+    g_SignalFromPanel.setSignal(nullptr);
+}
+
+void RWDEFCloseDevice() {
+    CloseCommunication();
+    g_Timing = &g_LocalTiming;
+    g_AudioRingReady.store(false, std::memory_order_relaxed);
+    g_AudioRingFailed = false;
+    g_AudioRing.close();
+    g_Control.close();
+    FreeDeviceMemory();
+    g_RenderQuantum = 0;
 }
 
 static void RestartDevice() {
-	RWDEFCloseDevice();
+	CloseCommunication();
 	ReWireOpenInfo openInfo;
 	ReWirePrepareOpenInfo(&openInfo, g_AudioInfo.fSampleRate, g_AudioInfo.fMaxBufferSize);
 	RWDEFOpenDevice(&openInfo);
@@ -137,23 +333,75 @@ static void RestartDevice() {
  *
  ******************************************************************************/
 
+/**
+ * The requested block does not necessarily start where this callback's block does: with render-ahead it is played
+ * after the blocks that are still outstanding. While the mixer plays we extrapolate its position that far, wrapping
+ * around its loop; tempo changes on the way cannot be foreseen.
+**/
+static int32_t PositionAfterFrames(const ReWireDriveAudioInputParams* inputParams, uint32_t frames) {
+    int32_t position = inputParams->fPPQ15360TickOfBatchStart;
+    if (!frames || kReWirePlayModeStopped == inputParams->fPlayMode) return position;
+
+    position += FramesToPPQ15360((int32_t)frames, inputParams->fTempo);
+    const int32_t loopLength = inputParams->fLoopEndPPQ15360Pos - inputParams->fLoopStartPPQ15360Pos;
+    if (inputParams->fLoopOn && loopLength > 0 && position >= inputParams->fLoopEndPPQ15360Pos)
+        position = inputParams->fLoopStartPPQ15360Pos + (position - inputParams->fLoopEndPPQ15360Pos) % loopLength;
+    return position;
+}
+
+static void FillTransportState(MPTTransportState& transport, const ReWireDriveAudioInputParams* inputParams) {
+    transport.playMode = inputParams->fPlayMode;
+    transport.tempo = inputParams->fTempo;
+    transport.signatureNumerator = inputParams->fSignatureNumerator;
+    transport.signatureDenominator = inputParams->fSignatureDenominator;
+    transport.ppq15360Position = PositionAfterFrames(inputParams, g_OutstandingBlocks * inputParams->fFramesToRender);
+}
+
+// The render quantum may be larger than any block of the mixer
+static int32_t PanelMaxBufferSize(const ReWireDriveAudioInputParams* inputParams) {
+    return ((int32_t)inputParams->fFramesToRender > g_AudioInfo.fMaxBufferSize) ? (int32_t)inputParams->fFramesToRender : g_AudioInfo.fMaxBufferSize;
+}
+
+// As many of the largest channel message as half the pipe holds, whatever format the panel picks
+static uint32_t GrantCredits(const ReWireDriveAudioInputParams* inputParams) {
+    if (!g_Control.isOpen() || g_RenderAhead) return 0;
+    size_t messageSize = (size_t)inputParams->fFramesToRender * 2 * sizeof(int32_t);
+    if (messageSize > MPTMaxChunkSize(2 * sizeof(int32_t))) messageSize = MPTMaxChunkSize(2 * sizeof(int32_t));
+    messageSize += sizeof(MPTAudioResponse);
+    const uint32_t credits = (uint32_t)(PIPE_SIZE_RT / (MPT_CREDIT_MESSAGE_FACTOR * messageSize));
+    return (credits >= 2) ? credits : 0;  // a single one is no better than stop-and-wait
+}
+
 static bool SendRenderRequestToPanel(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams) {
     MPTAudioRequest request;
     request.sampleRate = g_AudioInfo.fSampleRate;
-    request.maxBufferSize = g_AudioInfo.fMaxBufferSize;
+    request.maxBufferSize = PanelMaxBufferSize(inputParams);
     request.framesToRender = inputParams->fFramesToRender;
+    request.sequence = ++g_RequestSequence;
+    request.capabilities = MPT_CAP_BATCHED | MPT_CAP_FLOAT32 | MPT_CAP_PACKED24 | MPT_CAP_PACKED16;
+    if (DoesBlockFitAudioRing(request.framesToRender)) request.capabilities |= MPT_CAP_SHARED_MEMORY;
+    if (g_Offline) request.capabilities |= MPT_CAP_OFFLINE;
+    request.renderAhead = g_RenderAhead;
+    FillTransportState(request.transport, inputParams);
+    request.credits = g_Credits = GrantCredits(inputParams);
+    if (g_Credits) g_Control.header()->consumedMessages.store(0, std::memory_order_relaxed);
 
     ReWireError status = RWDComSend(g_DevicePortHandle, PIPE_RT, sizeof(request), (ReWire_uint8_t*)&request);
     switch (status) {
         case kReWireError_NoError:
-            SetEvent(g_EventToPanel);
+            g_SignalToPanel.set();
+            if (g_Offline) MPTIncrementCounter(g_Timing->offlineBlocks);
             return true; // success
 
         case kReWireError_PortNotConnected:
+            ForgetPanelSession();
             break; // this is fine; the panel wasn't connected
 		case kReWireImplError_InvalidParameter:
+            ForgetPanelSession();
             break; // panel had quit abruptly, just do nothing
 		case kReWireError_BufferFull:
+			// During a bounce the panel is merely slow, it will catch up
+			if (g_Offline) break;
 			DEBUG_PRINT("DEVICE: RWDComSend returned kReWireError_BufferFull. Recovering...");
 			RestartDevice();
 			break;
@@ -168,6 +416,9 @@ static void SwallowRemainingAudioMessages() {
 	do {
 		status = RWDComRead(g_DevicePortHandle, PIPE_RT, &messageSize, g_IncomingData);
 	} while(kReWireError_NoError == status);  // while messages were still in the pipe
+
+	// Blocks the panel published after we had given up on them are stale as well
+	if(IsAudioRingReady()) g_AudioRing.discardPending();
 }
 
 static bool MakeSureWeCanWaitForPanel() {
@@ -178,44 +429,60 @@ static bool MakeSureWeCanWaitForPanel() {
         DEBUG_PRINT("DEVICE: OpenEventA failed, error=%i.", (int)GetLastError());
         return false;
     }
+    g_SignalFromPanel.setEvent(g_EventFromPanel);
     return true;
 }
 
+// The panel decides whether we wake each other through the shared signals, it may come and go at any time
+static void UpdateSignals(const ReWireDriveAudioInputParams* inputParams) {
+    MPTSharedControlHeader* header = g_Control.header();
+    const bool useSignals = header && header->panelUsesSignals.load(std::memory_order_acquire);
+    g_SignalToPanel.setSignal(useSignals ? &header->signalToPanel : nullptr);
+    g_SignalFromPanel.setSignal(useSignals ? &header->signalToDevice : nullptr);
+
+    const bool spin = useSignals && header->spinWaitEnabled.load(std::memory_order_relaxed);
+    if (spin != g_SpinWaitEnabled) {
+        g_SpinWaitEnabled = spin;
+        g_SignalFromPanel.enableSpinning(spin);
+    }
+    g_SignalFromPanel.setBlockDuration(inputParams->fFramesToRender, g_AudioInfo.fSampleRate);
+}
+
 // true: success, false: failure
 static bool WaitForPanel(const int milliseconds = 100) {
 
-    switch (WaitForSingleObject(g_EventFromPanel, milliseconds)) {
-    case WAIT_ABANDONED:
-    case WAIT_OBJECT_0:
-        return true; // success; an audio channel awaits!
-    case WAIT_TIMEOUT:
-		// The panel may have quit abruptly, test whether this is the case
-		if(kReWireError_PortStale == RWDComCheckConnection(g_DevicePortHandle)) {
-			RestartDevice();
-		}
-		break;
-    case WAIT_FAILED: // 6 = INVALID_HANDLE
-        DEBUG_PRINT("DEVICE: AwaitAudioChannelsFromPanel WAIT_FAILED, error=%i.\n", (int)GetLastError());
+    // A bounce waits for a slow block instead of dropping it, as long as the panel is still there
+    int attempts = g_Offline ? OFFLINE_MAX_WAIT_MS / milliseconds : 1;
+    while (attempts--) {
+        switch (g_SignalFromPanel.wait(milliseconds)) {
+        case MPTWaitResult::Spun:
+            MPTIncrementCounter(g_Timing->spinHits);
+            return true; // success; an audio channel awaits!
+        case MPTWaitResult::Woken:
+            MPTIncrementCounter(g_Timing->kernelWaits);
+            return true;
+        case MPTWaitResult::Timeout:
+            MPTIncrementCounter(g_Timing->kernelWaits);
+            MPTIncrementCounter(g_Timing->timeouts);
+            // The panel may have quit abruptly, test whether this is the case
+            if (kReWireError_PortStale == RWDComCheckConnection(g_DevicePortHandle)) {
+                RestartDevice();
+                return false;
+            }
+            break;
+        case MPTWaitResult::Failed: // 6 = INVALID_HANDLE
+            DEBUG_PRINT("DEVICE: AwaitAudioChannelsFromPanel WAIT_FAILED, error=%i.\n", (int)GetLastError());
+            return false;
+        }
     }
-    return false; // timeout or error
+    return false; // timeout
 
 }
 
-static bool DownloadResponseHeader(MPTAudioResponseHeader* pResponseHeader) {
-	if (!WaitForPanel()) return false;
-
-    // Read the actual audio request header
-    uint16_t msgSize;
-	ReWireError status = RWDComRead(g_DevicePortHandle, PIPE_RT, &msgSize, g_IncomingData);
-
-	if(kReWireError_NoError != status) {
-		DEBUG_PRINT("DEVICE: DownloadResponseHeader RWDComRead returned %i.\n", status);
-		return false;
-	}
-
-    if (msgSize != sizeof(MPTAudioResponseHeader)) {
+static bool ParseResponseHeader(uint16_t msgSize, const ReWireDriveAudioInputParams* inputParams, MPTAudioResponseHeader* pResponseHeader) {
+    if (msgSize < sizeof(MPTAudioResponseHeader)) {
 		DEBUG_PRINT(
-            "DEVICE: DownloadResponseHeader msg size %i instead of %i: Discrepancy between expected message type and read message type.\n",
+            "DEVICE: ParseResponseHeader msg size %i instead of %i: Discrepancy between expected message type and read message type.\n",
             msgSize, (int)sizeof(MPTAudioResponseHeader)
         );
         return false;
@@ -223,112 +490,597 @@ static bool DownloadResponseHeader(MPTAudioResponseHeader* pResponseHeader) {
     
     memcpy((uint8_t *)pResponseHeader, g_IncomingData, sizeof(MPTAudioResponseHeader));
 
-	SetEvent(g_EventToPanel);
+    // Only a batch carries audio after the header
+    size_t szExpected = sizeof(MPTAudioResponseHeader);
+    if (pResponseHeader->flags & MPT_CAP_BATCHED) {
+        for (uint32_t channel = 0; channel < g_BusCount; channel++) {
+            if (ReWireIsBitInBitFieldSet(pResponseHeader->servedChannelsBitfield, channel))
+                szExpected += (size_t)inputParams->fFramesToRender * MPTPayloadFrameSize(pResponseHeader->flags);
+        }
+    }
+    if (msgSize != szExpected) {
+        DEBUG_PRINT("DEVICE: ParseResponseHeader message was of size %li, expected %li.\n", (long)msgSize, (long)szExpected);
+        return false;
+    }
 	return true;
 }
 
-static bool DownloadAudioChannelFromPanel(const ReWireDriveAudioInputParams* inputParams) {
+// Skips ring slots that answer requests we already gave up on
+static const MPTSharedRingSlot* PeekRingSlot(uint32_t sequence) {
+    const MPTSharedRingSlot* slot;
+    while ((slot = g_AudioRing.peekReadSlot()) != nullptr) {
+        if (slot->sequence == sequence) return slot;
+        if (static_cast<int32_t>(sequence - slot->sequence) < 0) return nullptr;  // we are the ones behind
+        DEBUG_PRINT("DEVICE: Dropping stale shared audio ring slot for block %u.\n", slot->sequence);
+        g_AudioRing.releaseReadSlot();
+    }
+    return nullptr;
+}
+
+/**
+ * Waits until the panel answered request `sequence`. Ring slots carry their own header, in which case
+ * *pSlot points at the slot; otherwise the header arrived as a message and *pSlot is nullptr.
+**/
+static bool AwaitPanelResponse(uint32_t sequence, const ReWireDriveAudioInputParams* inputParams, MPTAudioResponseHeader* pResponseHeader, const MPTSharedRingSlot** pSlot) {
+    *pSlot = nullptr;
+    for (;;) {
+        // When rendering ahead the block is usually there already and we need not wait at all
+        if (IsAudioRingReady()) {
+            const MPTSharedRingSlot* slot = PeekRingSlot(sequence);
+            if (slot) {
+                *pResponseHeader = slot->responseHeader;
+                *pSlot = slot;
+                return true;
+            }
+        }
+
+        // A header message comes with a wakeup of its own, which has to be consumed before the per-channel
+        // handshakes start
+        if (!WaitForPanel()) return false;
+
+        uint16_t msgSize;
+        ReWireError status = RWDComRead(g_DevicePortHandle, PIPE_RT, &msgSize, g_IncomingData);
+        if (kReWireError_NoError == status)
+            return ParseResponseHeader(msgSize, inputParams, pResponseHeader);
+        if (kReWireError_NoMoreMessages != status) {
+            DEBUG_PRINT("DEVICE: AwaitPanelResponse RWDComRead returned %i.\n", status);
+            return false;
+        }
+    }
+}
+
+/**
+ * Waits for the next audio channel message, which is a whole channel or one chunk of it. During a bounce, or while
+ * it has credits, the panel does not wait for our acknowledgements, so several messages may be queued behind a
+ * single wakeup and we look before we wait. Wakeups left over from those are harmless, we just wait again if there is no message after all.
+ * szExpectedMax is for panels that send a channel with room for the largest block, 0 if there are none.
+**/
+static bool DownloadAudioChunkFromPanel(size_t szExpected, size_t szExpectedMax) {
 
-    // We presume that there's an audio channel message waiting for us
     uint16_t messageSize = 0;
-    ReWireError status = RWDComRead(g_DevicePortHandle, PIPE_RT, &messageSize, g_IncomingData);
-    if (kReWireError_NoError != status) {
-        // big problem
-        DEBUG_PRINT("DEVICE: DownloadAudioChannelFromPanel RWDComRead returned %i.\n", status);
-        return false;
+    bool wait = !g_Offline && !g_UsingCredits;
+    for (;;) {
+        if (wait && !WaitForPanel()) return false;
+        wait = true;
+
+        ReWireError status = RWDComRead(g_DevicePortHandle, PIPE_RT, &messageSize, g_IncomingData);
+        if (kReWireError_NoError == status) break;
+        if (kReWireError_NoMoreMessages != status) {
+            // big problem
+            DEBUG_PRINT("DEVICE: DownloadAudioChunkFromPanel RWDComRead returned %i.\n", status);
+            return false;
+        }
     }
 
     // Make sure the message is of expected size
-    size_t szExpectedMin = sizeof(MPTAudioResponse) + (size_t)inputParams->fFramesToRender * 2 * sizeof(int32_t);
-    size_t szExpectedMax = sizeof(MPTAudioResponse) + (size_t)g_AudioInfo.fMaxBufferSize * 2 * sizeof(int32_t);
-    if (!(messageSize == szExpectedMin || messageSize == szExpectedMax)) {
-        DEBUG_PRINT("DEVICE: DownloadAudioChannelFromPanel message was of size %li, expected %li or %li.\n",
-            (long)messageSize, (long)szExpectedMin, (long)szExpectedMax);
+    if (!(messageSize == szExpected || messageSize == szExpectedMax)) {
+        DEBUG_PRINT("DEVICE: DownloadAudioChunkFromPanel message was of size %li, expected %li.\n",
+            (long)messageSize, (long)szExpected);
         return false;
     }
 
     return true; // success
 }
 
-static void UploadAudioChannelToMixer(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+// Deinterleaves frameCount frames of a channel, starting at firstFrame, into the mixer's buffers.
+// Packed samples are unpacked in the same pass.
+static void DeinterleaveIntoMixer(int channelIndex, const uint8_t* pAudio, uint32_t flags, uint32_t firstFrame, uint32_t frameCount, const ReWireDriveAudioInputParams* inputParams)
 {
-    // Mark channel as served
-    MPTAudioResponse* msg = reinterpret_cast<MPTAudioResponse*>(g_IncomingData);
-    ReWireSetBitInBitField(outputParams->fServedChannelsBitField, 2 * msg->channelIndex);
-    ReWireSetBitInBitField(outputParams->fServedChannelsBitField, 2 * msg->channelIndex + 1);
+    float* pOutL = inputParams->fAudioBuffers[2 * channelIndex] + firstFrame;
+    float* pOutR = inputParams->fAudioBuffers[2 * channelIndex + 1] + firstFrame;
+    if (flags & MPT_CAP_PACKED16)
+        g_Kernels->deinterleaveInt16(reinterpret_cast<const int16_t*>(pAudio), pOutL, pOutR, frameCount, 1.0f / MPT_INT16_SCALEF);
+    else if (flags & MPT_CAP_PACKED24)
+        g_Kernels->deinterleaveInt24(pAudio, pOutL, pOutR, frameCount, 1.0f / MPT_INT24_SCALEF);
+    else if (flags & MPT_CAP_FLOAT32)
+        g_Kernels->deinterleaveFloat32(reinterpret_cast<const float*>(pAudio), pOutL, pOutR, frameCount);
+    else
+        g_Kernels->deinterleaveInt32(reinterpret_cast<const int32_t*>(pAudio), pOutL, pOutR, frameCount, 1.0f / MIXING_SCALEF);
+}
 
+static void MarkChannelAsServed(int channelIndex, ReWireDriveAudioOutputParams* outputParams)
+{
+    ReWireSetBitInBitField(outputParams->fServedChannelsBitField, 2 * channelIndex);
+    ReWireSetBitInBitField(outputParams->fServedChannelsBitField, 2 * channelIndex + 1);
+    g_ZeroedBuffers[2 * channelIndex] = g_ZeroedBuffers[2 * channelIndex + 1] = nullptr;
+}
+
+static void UploadAudioChannelToMixer(int channelIndex, const uint8_t* pServedChannel, uint32_t flags, const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
     // Upload deinterleaved interleaved channel into mixer's buffers
-	int *pServedChannel = reinterpret_cast<int *>(g_IncomingData + sizeof(MPTAudioResponse));
-    float* pOutL = inputParams->fAudioBuffers[2 * msg->channelIndex];
-    float* pOutR = inputParams->fAudioBuffers[2 * msg->channelIndex + 1];
-    for (uint32_t s = 0; s < inputParams->fFramesToRender; s++) {
-        *pOutL++ = static_cast<float>(*pServedChannel++) / MIXING_SCALEF;
-        *pOutR++ = static_cast<float>(*pServedChannel++) / MIXING_SCALEF;
+    DeinterleaveIntoMixer(channelIndex, pServedChannel, flags, 0, inputParams->fFramesToRender, inputParams);
+    MarkChannelAsServed(channelIndex, outputParams);
+}
+
+/**
+ * Lets the panel know that we consumed a message of the per-channel path, unless it was the last one of the block.
+ * With credits that is one more consumed message, and a wakeup only whenever another half of them came back.
+**/
+static void AcknowledgeMessage(bool lastMessage) {
+    if (g_UsingCredits) {
+        std::atomic<uint32_t>& consumed = g_Control.header()->consumedMessages;
+        const uint32_t consumedMessages = consumed.load(std::memory_order_relaxed) + 1;
+        consumed.store(consumedMessages, std::memory_order_release);
+        const uint32_t batch = (g_Credits / 2) ? g_Credits / 2 : 1;
+        if (!lastMessage && !g_Offline && 0 == consumedMessages % batch) g_SignalToPanel.set();
+        return;
+    }
+    if (!lastMessage && !g_Offline) g_SignalToPanel.set();
+}
+
+/**
+ * Reassembles a channel from the chunks it was sent in, straight into the mixer's buffers; a channel that fits
+ * through the pipe is a single chunk. Every message but the last one of the block is acknowledged.
+**/
+static bool DownloadAudioChannelFromPanel(int channelIndex, bool lastChannel, uint32_t flags, const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
+    const uint32_t frameSize = MPTPayloadFrameSize(flags);
+    const size_t maxChunkSize = MPTMaxChunkSize(frameSize);
+    const size_t audioDataSize = (size_t)inputParams->fFramesToRender * frameSize;
+    for (size_t offset = 0; offset < audioDataSize; ) {
+        size_t chunkSize = audioDataSize - offset;
+        if (chunkSize > maxChunkSize) chunkSize = maxChunkSize;
+
+        // Only the first chunk starts with its MPTAudioResponse
+        const size_t prefixSize = offset ? 0 : sizeof(MPTAudioResponse);
+        const size_t szExpectedMax = (chunkSize == audioDataSize) ? sizeof(MPTAudioResponse) + (size_t)PanelMaxBufferSize(inputParams) * frameSize : 0;
+        if (!DownloadAudioChunkFromPanel(prefixSize + chunkSize, szExpectedMax)) return false;
+        if (!offset && reinterpret_cast<const MPTAudioResponse*>(g_IncomingData)->channelIndex != channelIndex) {
+            DEBUG_PRINT("DEVICE: Received channel %i instead of %i.\n", (int)reinterpret_cast<const MPTAudioResponse*>(g_IncomingData)->channelIndex, channelIndex);
+            return false;
+        }
+
+        DeinterleaveIntoMixer(channelIndex, g_IncomingData + prefixSize, flags, (uint32_t)(offset / frameSize), (uint32_t)(chunkSize / frameSize), inputParams);
+        offset += chunkSize;
+
+        // Signal to the panel that we have received and processed the chunk
+        AcknowledgeMessage(lastChannel && offset == audioDataSize);
     }
 
+    MarkChannelAsServed(channelIndex, outputParams);
+    return true;
 }
 
 
 static void ZeroAudioChannel(int channelIndex, const ReWireDriveAudioInputParams *inputParams)
 {
+	// 0.0f is all zero bits, so the CRT's vectorized memset does the job
 	float *pOutL = inputParams->fAudioBuffers[2 * channelIndex];
 	float *pOutR = inputParams->fAudioBuffers[2 * channelIndex + 1];
-	for(uint32_t s = 0; s < inputParams->fFramesToRender; s++)
-	{
-		*pOutL++ = 0.0f;
-	}
-	for(uint32_t s = 0; s < inputParams->fFramesToRender; s++)
+	memset(pOutL, 0, inputParams->fFramesToRender * sizeof(float));
+	memset(pOutR, 0, inputParams->fFramesToRender * sizeof(float));
+	g_ZeroedBuffers[2 * channelIndex] = pOutL;
+	g_ZeroedBuffers[2 * channelIndex + 1] = pOutR;
+	g_ChannelsZeroed++;
+}
+
+
+// Handles a channel the panel did not transmit, silent or not rendered at all.
+// It needs zeroing if we wrote audio into its mixer buffers since the last time, or if the mixer handed us different
+// buffers. Buffers we left zeroed are only skipped once a scan proved them still zero: ReWire does not promise
+// that the mixer keeps its hands off them in between, and an equal pointer cannot tell. Scanning reads only,
+// so a clean buffer costs no stores and no write-backs, and the scan bails out on the first sample the mixer wrote.
+static void ZeroUnservedChannel(int channelIndex, const ReWireDriveAudioInputParams *inputParams)
+{
+	// Channels the panel did not serve are never read from the render quantum
+	if(inputParams->fAudioBuffers == g_QuantumBuffers) return;
+
+	const size_t frames = inputParams->fFramesToRender;
+	float *pOutL = inputParams->fAudioBuffers[2 * channelIndex];
+	float *pOutR = inputParams->fAudioBuffers[2 * channelIndex + 1];
+	if(g_ZeroedBuffers[2 * channelIndex] == pOutL && g_ZeroedBuffers[2 * channelIndex + 1] == pOutR
+		&& g_Kernels->isSilent(reinterpret_cast<const uint32_t *>(pOutL), frames)
+		&& g_Kernels->isSilent(reinterpret_cast<const uint32_t *>(pOutR), frames))
 	{
-		*pOutR++ = 0.0f;
+		g_ChannelsZeroingAvoided++;
+		g_BytesZeroingAvoided += (uint64_t)inputParams->fFramesToRender * 2 * sizeof(float);
+		return;
 	}
+	ZeroAudioChannel(channelIndex, inputParams);
 }
 
 
+// Makes the counters visible to the panel through the shared region
+static void PublishDeviceStats()
+{
+	if (!g_Control.isOpen()) return;
+	MPTSharedControlHeader* header = g_Control.header();
+	header->channelsZeroed.store(g_ChannelsZeroed, std::memory_order_relaxed);
+	header->channelsZeroingAvoided.store(g_ChannelsZeroingAvoided, std::memory_order_relaxed);
+	header->bytesZeroingAvoided.store(g_BytesZeroingAvoided, std::memory_order_relaxed);
+}
 
-void RWDEFDriveAudio(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+
+// Reads a block that arrived in a single message, right behind its header
+static void UploadAudioBlockFromBatch(const MPTAudioResponseHeader& responseHeader, const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
 {
-#ifdef DEBUG
-    if (g_LastFramesToRender != inputParams->fFramesToRender) {
-        g_LastFramesToRender = inputParams->fFramesToRender;
-        DEBUG_PRINT("DEVICE: RWDEFDriveAudio inputParams->fFramesToRender = %i.\n", (int)inputParams->fFramesToRender);
-	}
-#endif
+    const uint8_t* pServedChannel = g_IncomingData + sizeof(MPTAudioResponseHeader);
+    const size_t channelSize = (size_t)inputParams->fFramesToRender * MPTPayloadFrameSize(responseHeader.flags);
+    for (int channel = 0; channel < (int)g_BusCount; channel++)
+    {
+		if(!ReWireIsBitInBitFieldSet(responseHeader.servedChannelsBitfield, channel)) {
+			ZeroUnservedChannel(channel, inputParams);
+			continue;
+		}
+		UploadAudioChannelToMixer(channel, pServedChannel, responseHeader.flags, inputParams, outputParams);
+		pServedChannel += channelSize;
+    }
+}
+
+
+// Reads a block the panel rendered into the shared audio ring, in place, and hands the slot back
+static bool UploadAudioBlockFromRing(const MPTSharedRingSlot* slot, const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
+    if (slot->framesToRender != inputParams->fFramesToRender) {
+        DEBUG_PRINT("DEVICE: Shared audio ring slot holds %u frames instead of %u.\n", slot->framesToRender, (unsigned)inputParams->fFramesToRender);
+        g_AudioRing.releaseReadSlot();
+        return false;
+    }
+
+    const MPTAudioResponseHeader& responseHeader = slot->responseHeader;
+    for (int channel = 0; channel < (int)g_BusCount; channel++)
+    {
+		if(!ReWireIsBitInBitFieldSet(responseHeader.servedChannelsBitfield, channel)) {
+			ZeroUnservedChannel(channel, inputParams);
+			continue;
+		}
+		UploadAudioChannelToMixer(channel, reinterpret_cast<const uint8_t*>(g_AudioRing.channel(slot, channel)), responseHeader.flags, inputParams, outputParams);
+    }
+
+    g_AudioRing.releaseReadSlot();
+    return true;
+}
+
+
+
+/**
+ * Render-ahead: every callback sends one request and plays the answer to the one sent g_RenderAhead callbacks ago,
+ * so the panel renders while the mixer is busy with the block we hand it. The latency this adds is published
+ * through the shared region.
+**/
+static void ResetRenderAhead()
+{
+    SwallowRemainingAudioMessages();
+    g_OutstandingBlocks = 0;
+}
+
+static void UpdateRenderAhead(const ReWireDriveAudioInputParams* inputParams)
+{
+    uint32_t renderAhead = 0;
+    if (DoesBlockFitAudioRing(inputParams->fFramesToRender)) {
+        renderAhead = g_Control.header()->requestedRenderAhead.load(std::memory_order_relaxed);
+        if (renderAhead > MPT_MAX_RENDER_AHEAD) renderAhead = MPT_MAX_RENDER_AHEAD;
+
+        // A bounce is all about throughput, so let the panel run as far ahead as it is willing to
+        if (g_Offline) {
+            uint32_t offlineRenderAhead = g_Control.header()->offlineRenderAhead.load(std::memory_order_relaxed);
+            if (offlineRenderAhead > MPT_OFFLINE_RENDER_AHEAD) offlineRenderAhead = MPT_OFFLINE_RENDER_AHEAD;
+            if (offlineRenderAhead > renderAhead) renderAhead = offlineRenderAhead;
+        }
+
+        // Requests for a render quantum are not played by the callback that sends them anyway
+        if (g_RenderQuantum) renderAhead = 0;
+    }
+    if (g_Control.isOpen()) g_Control.header()->renderAheadLatencyFrames.store(renderAhead * inputParams->fFramesToRender, std::memory_order_relaxed);
 
+    // Blocks requested at another depth or block size cannot be played any more
+    if (renderAhead != g_RenderAhead || g_RenderAheadFramesToRender != (uint32_t)inputParams->fFramesToRender) {
+        if (g_OutstandingBlocks) ResetRenderAhead();
+        g_RenderAhead = renderAhead;
+        g_RenderAheadFramesToRender = inputParams->fFramesToRender;
+    }
+}
+
+static bool DriveAudioRenderAhead(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
+    // Prime an empty pipeline by also requesting the blocks the next callbacks are going to play,
+    // that way we only wait for the first one and do not have to output silence
+    uint32_t requestCount = g_OutstandingBlocks ? 1 : 1 + g_RenderAhead;
+    for (uint32_t i = 0; i < requestCount; i++) {
+        if (!SendRenderRequestToPanel(inputParams, outputParams)) {
+            ResetRenderAhead();
+            return false; // port not connected or error
+        }
+        g_OutstandingBlocks++;
+    }
+    g_RequestSentNs = MPTNowNs();
+
+    if (!MakeSureWeCanWaitForPanel())
+        return false; // this should never happen
+
+    // Play the oldest outstanding block
+    MPTAudioResponseHeader responseHeader;
+    const MPTSharedRingSlot* slot;
+    const bool received = AwaitPanelResponse(g_RequestSequence - g_OutstandingBlocks + 1, inputParams, &responseHeader, &slot);
+    if (received) g_HeaderReceivedNs = MPTNowNs();
+    if (!received || !slot || !UploadAudioBlockFromRing(slot, inputParams, outputParams)) {
+        // The panel fell behind or skipped a block; start over instead of playing everything shifted
+        DEBUG_PRINT("DEVICE: Render-ahead underrun, restarting the pipeline.\n");
+        ResetRenderAhead();
+        return false;
+    }
+    g_OutstandingBlocks--;
+
+    PollAndHandleEvents(inputParams, outputParams, responseHeader.renderPosition + inputParams->fFramesToRender);
+    return true;
+}
+
+
+
+/**
+ * Lockstep: request a block of inputParams->fFramesToRender frames and upload it to inputParams->fAudioBuffers
+ * as soon as it arrives. Leaves the events to the caller, responseHeader is only valid if g_HeaderReceivedNs is set.
+**/
+static bool RequestBlockFromPanel(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams, MPTAudioResponseHeader& responseHeader)
+{
 	SwallowRemainingAudioMessages();
 
     if (!SendRenderRequestToPanel(inputParams, outputParams))
-        return; // port not connected or error
+        return false; // port not connected or error
+    g_RequestSentNs = MPTNowNs();
 
     if (!MakeSureWeCanWaitForPanel())
-        return; // this should never happen
+        return false; // this should never happen
 
     // Receive audio response header
-	MPTAudioResponseHeader responseHeader;
-	if (!DownloadResponseHeader(&responseHeader))
-        return;
+	const MPTSharedRingSlot* slot;
+	if (!AwaitPanelResponse(g_RequestSequence, inputParams, &responseHeader, &slot))
+        return false;
+    g_HeaderReceivedNs = MPTNowNs();
+
+    // Channels in shared memory or in a batch need no further handshakes
+    if (slot)
+        return UploadAudioBlockFromRing(slot, inputParams, outputParams);
+    if (responseHeader.flags & MPT_CAP_BATCHED) {
+        UploadAudioBlockFromBatch(responseHeader, inputParams, outputParams);
+        return true;
+    }
+
+    // Per-channel fallback: acknowledge the header, then every message but the last one separately, or return
+    // credits for them. During a bounce the panel does not wait for either and we only keep up with its messages.
+    int lastChannel = -1;
+    for (int channel = 0; channel < (int)g_BusCount; channel++) {
+        if (ReWireIsBitInBitFieldSet(responseHeader.servedChannelsBitfield, channel))
+            lastChannel = channel;
+    }
+    g_UsingCredits = g_Credits && (responseHeader.flags & MPT_CAP_CREDITS);
+    AcknowledgeMessage(g_UsingCredits && lastChannel < 0);
 
     // Poll and process audio buffers
-    for (int channel = 0; channel < kReWireAudioChannelCount / 2; channel++)
+    for (int channel = 0; channel < (int)g_BusCount; channel++)
     {
 		// Only download channels rendered by OpenMPT
 		if(!ReWireIsBitInBitFieldSet(responseHeader.servedChannelsBitfield, channel)) {
-			ZeroAudioChannel(channel, inputParams);
+			ZeroUnservedChannel(channel, inputParams);
 			continue;
         }
 
-        // Await audio channel packets from panel
-		if(!WaitForPanel()) return;
+        // Await audio channel packets from panel and process them
+        if (!DownloadAudioChannelFromPanel(channel, channel == lastChannel, responseHeader.flags, inputParams, outputParams)) return false;
+    }
+	return true;
+}
+
+
+
+/**
+ * Render quantum: when the mixer calls us with tiny blocks, the messages cost more than the audio. The panel then
+ * renders g_RenderQuantum frames at a time into a FIFO of our own, and the callbacks in between are served from it
+ * without a single message. The last frames of a quantum were rendered g_RenderQuantum - fFramesToRender frames
+ * before the mixer plays them, which is the latency this adds and what we publish.
+**/
+static void UpdateRenderQuantum(const ReWireDriveAudioInputParams* inputParams)
+{
+    uint32_t quantum = 0;
+    if (g_Control.isOpen()) {
+        quantum = g_Control.header()->requestedRenderQuantum.load(std::memory_order_relaxed);
+        if (quantum > MPT_MAX_RENDER_QUANTUM) quantum = MPT_MAX_RENDER_QUANTUM;
+        if (quantum <= inputParams->fFramesToRender) quantum = 0;  // nothing to gain
+        g_Control.header()->renderQuantumLatencyFrames.store(quantum ? quantum - inputParams->fFramesToRender : 0, std::memory_order_relaxed);
+    }
+
+    // What is left in the FIFO was rendered for another quantum and cannot be played seamlessly
+    if (quantum != g_RenderQuantum) {
+        g_RenderQuantum = quantum;
+        g_QuantumFrames = g_QuantumReadPosition = 0;
+    }
+}
+
+// Requests the next quantum; it starts framesPlayed frames into the mixer's current block
+static bool FillRenderQuantum(const ReWireDriveAudioInputParams* inputParams, uint32_t framesPlayed)
+{
+    ReWireDriveAudioInputParams quantumParams = *inputParams;
+    quantumParams.fAudioBuffers = g_QuantumBuffers;
+    quantumParams.fFramesToRender = g_RenderQuantum;
+    quantumParams.fPPQ15360TickOfBatchStart = PositionAfterFrames(inputParams, framesPlayed);
+
+    ReWireDriveAudioOutputParams quantumOutput;
+    memset(&quantumOutput, 0, sizeof(quantumOutput));
+    MPTAudioResponseHeader responseHeader;
+    g_QuantumFrames = g_QuantumReadPosition = 0;
+    if (!RequestBlockFromPanel(&quantumParams, &quantumOutput, responseHeader)) return false;
+
+    memcpy(g_QuantumServedChannels, quantumOutput.fServedChannelsBitField, sizeof(g_QuantumServedChannels));
+    g_QuantumRenderPosition = responseHeader.renderPosition;
+    g_QuantumFrames = g_RenderQuantum;
+    return true;
+}
+
+static bool DriveAudioFromRenderQuantum(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
+    const uint32_t framesToRender = inputParams->fFramesToRender;
+
+    // A block of the mixer may span two quanta, and a channel may be served in only one of them
+    bool uploaded = true;
+    uint32_t written = 0;
+    while (written < framesToRender) {
+        if (g_QuantumReadPosition == g_QuantumFrames && !FillRenderQuantum(inputParams, written)) {
+            uploaded = false;
+            break;
+        }
 
-        // Process the received audio channel
-        if (!DownloadAudioChannelFromPanel(inputParams)) return;
-        UploadAudioChannelToMixer(inputParams, outputParams);
+        uint32_t frames = g_QuantumFrames - g_QuantumReadPosition;
+        if (frames > framesToRender - written) frames = framesToRender - written;
+        for (int channel = 0; channel < 2 * (int)g_BusCount; channel++) {
+            float* pOut = inputParams->fAudioBuffers[channel];
+            const bool served = (0 != ReWireIsBitInBitFieldSet(outputParams->fServedChannelsBitField, (ReWire_uint16_t)channel));
+            if (ReWireIsBitInBitFieldSet(g_QuantumServedChannels, (ReWire_uint16_t)channel)) {
+                if (!served && written) memset(pOut, 0, written * sizeof(float));
+                memcpy(pOut + written, g_QuantumBuffers[channel] + g_QuantumReadPosition, frames * sizeof(float));
+            } else if (served) {
+                memset(pOut + written, 0, frames * sizeof(float));
+            }
+        }
+        for (int channel = 0; channel < (int)g_BusCount; channel++) {
+            if (ReWireIsBitInBitFieldSet(g_QuantumServedChannels, (ReWire_uint16_t)(2 * channel)))
+                MarkChannelAsServed(channel, outputParams);
+        }
+        g_QuantumReadPosition += frames;
+        written += frames;
+    }
 
-        // Signal to the panel that we have received and processed the channel
-        SetEvent(g_EventToPanel);
+    // Whatever was not served at all, or is missing because the panel did not deliver, ends up silent
+    for (int channel = 0; channel < (int)g_BusCount; channel++) {
+        if (!ReWireIsBitInBitFieldSet(outputParams->fServedChannelsBitField, (ReWire_uint16_t)(2 * channel)))
+            ZeroUnservedChannel(channel, inputParams);
+        else if (written < framesToRender) {
+            memset(inputParams->fAudioBuffers[2 * channel] + written, 0, (framesToRender - written) * sizeof(float));
+            memset(inputParams->fAudioBuffers[2 * channel + 1] + written, 0, (framesToRender - written) * sizeof(float));
+        }
     }
 
-	PollAndHandleEvents(outputParams);
+    if (uploaded && !g_RequestSentNs) MPTIncrementCounter(g_Timing->quantumCallbacks);
 
+    // Events are due by what the mixer has played so far, not by what the panel rendered
+    if (g_QuantumFrames)
+        PollAndHandleEvents(inputParams, outputParams, g_QuantumRenderPosition + g_QuantumReadPosition);
+    return uploaded;
+}
+
+
+
+// Returns true if the requested block was uploaded to the mixer in full
+static bool DriveAudio(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
+#ifdef DEBUG
+    if (g_LastFramesToRender != inputParams->fFramesToRender) {
+        g_LastFramesToRender = inputParams->fFramesToRender;
+        DEBUG_PRINT("DEVICE: RWDEFDriveAudio inputParams->fFramesToRender = %i.\n", (int)inputParams->fFramesToRender);
+	}
+#endif
+
+	PublishDeviceStats();
+
+    // Buffers zeroed for a shorter block have a stale tail, so forget about all of them
+    if (g_ZeroedFramesToRender != inputParams->fFramesToRender) {
+        g_ZeroedFramesToRender = inputParams->fFramesToRender;
+        memset(g_ZeroedBuffers, 0, sizeof(g_ZeroedBuffers));
+    }
+
+    UpdateSignals(inputParams);
+    UpdateRenderQuantum(inputParams);
+    UpdateRenderAhead(inputParams);
+    if (g_RenderQuantum)
+        return DriveAudioFromRenderQuantum(inputParams, outputParams);
+    if (g_RenderAhead)
+        return DriveAudioRenderAhead(inputParams, outputParams);
+
+    MPTAudioResponseHeader responseHeader;
+    const bool uploaded = RequestBlockFromPanel(inputParams, outputParams, responseHeader);
+    if (g_HeaderReceivedNs)
+        PollAndHandleEvents(inputParams, outputParams, responseHeader.renderPosition + inputParams->fFramesToRender);
+    return uploaded;
+}
+
+/**
+ * ReWire does not tell us when the mixer bounces, but it shows: in real time the mixer asks for as many frames as
+ * the sound card plays, while a bounce asks for them as fast as we deliver. Single callbacks tell us nothing, mixers
+ * that split a large hardware buffer call us many times back to back and then not at all, so we compare the frames
+ * asked for with the wall-clock time over windows of OFFLINE_WINDOW_MS. A bounce needs OFFLINE_ENTER_WINDOWS of
+ * them at more than twice real-time speed: until then WaitForPanel() keeps its real-time timeout. One window at
+ * no more than 1.5 times real-time speed is playback again. A bounce slower than that is left alone; at that speed
+ * the rendering itself is the bottleneck rather than our messaging.
+**/
+static void UpdateOfflineDetection(uint64_t nowNs, uint32_t framesToRender) {
+    if (g_Control.isOpen() && !g_Control.header()->offlineDetection.load(std::memory_order_relaxed)) {
+        g_Offline = false;
+        g_OfflineStreak = 0;
+        g_OfflineWindowStartNs = 0;
+        return;
+    }
+
+    const uint64_t elapsedNs = nowNs - g_OfflineWindowStartNs;
+    if (g_OfflineWindowStartNs && elapsedNs >= (uint64_t)OFFLINE_WINDOW_MS * 1000000) {
+        // Frames per wall-clock time, relative to the sample rate
+        const uint64_t realTimeFrames = elapsedNs * g_AudioInfo.fSampleRate / 1000000000;
+        if (g_Offline) {
+            if (2 * g_OfflineWindowFrames <= 3 * realTimeFrames) {
+                g_Offline = false;
+                DEBUG_PRINT("DEVICE: Mixer is back to real time.\n");
+            }
+        } else {
+            g_OfflineStreak = (g_OfflineWindowFrames > 2 * realTimeFrames) ? g_OfflineStreak + 1 : 0;
+            if (g_OfflineStreak >= OFFLINE_ENTER_WINDOWS) {
+                g_Offline = true;
+                g_OfflineStreak = 0;
+                DEBUG_PRINT("DEVICE: Mixer bounces, switching to throughput mode.\n");
+            }
+        }
+        g_OfflineWindowStartNs = 0;
+    }
+    if (!g_OfflineWindowStartNs) {
+        g_OfflineWindowStartNs = nowNs;
+        g_OfflineWindowFrames = 0;
+    }
+    g_OfflineWindowFrames += framesToRender;
+}
+
+void RWDEFDriveAudio(const ReWireDriveAudioInputParams* inputParams, ReWireDriveAudioOutputParams* outputParams)
+{
+    const uint64_t startNs = MPTNowNs();
+
+    // How far the mixer strays from calling us once per block, which during a bounce means nothing
+    if (g_LastCallbackNs && g_AudioInfo.fSampleRate) {
+        const int64_t expectedNs = (int64_t)inputParams->fFramesToRender * 1000000000 / g_AudioInfo.fSampleRate;
+        const int64_t intervalNs = (int64_t)(startNs - g_LastCallbackNs);
+        const int64_t deviationNs = intervalNs - expectedNs;
+        if (!g_Offline) g_Timing->callbackJitter.record((uint64_t)(deviationNs < 0 ? -deviationNs : deviationNs));
+    }
+    g_LastCallbackNs = startNs;
+    if (g_AudioInfo.fSampleRate) UpdateOfflineDetection(startNs, inputParams->fFramesToRender);
+
+    g_RequestSentNs = g_HeaderReceivedNs = 0;
+    const bool uploaded = DriveAudio(inputParams, outputParams);
+    if (!g_RequestSentNs) return; // nobody to ask, e.g. the panel is not connected
+
+    const uint64_t endNs = MPTNowNs();
+    MPTIncrementCounter(g_Timing->blocks);
+    g_Timing->total.record(endNs - startNs);
+    if (g_HeaderReceivedNs) {
+        g_Timing->requestToHeader.record(g_HeaderReceivedNs - g_RequestSentNs);
+        if (uploaded) g_Timing->headerToLastChannel.record(endNs - g_HeaderReceivedNs);
+    }
+    if (!uploaded) MPTIncrementCounter(g_Timing->earlyReturns);
 }
 
 
@@ -341,6 +1093,7 @@ void RWDEFSetAudioInfo(const ReWireAudioInfo *audioInfo)
 
 	// A change in the audio info struct will automatically be noticed by the panel during audio requests
 	ReWirePrepareAudioInfo(&g_AudioInfo, audioInfo->fSampleRate, audioInfo->fMaxBufferSize);
+	PublishMaxBufferSize();
 }
 
 
@@ -352,7 +1105,12 @@ void RWDEFSetAudioInfo(const ReWireAudioInfo *audioInfo)
  *
  ******************************************************************************/
 
-void RWDEFIdle() {}
+void RWDEFIdle() {
+    // Open the panel's event on the mixer's idle thread as soon as the panel is there, not on its audio thread
+    if (!g_EventFromPanel && g_DevicePortHandle && kReWireError_PortConnected == RWDComCheckConnection(g_DevicePortHandle))
+        MakeSureWeCanWaitForPanel();
+    CreateAudioRing();
+}
 
 ReWireError RWDEFLaunchPanelApp() {
 	return kReWireError_NoError; // OpenMPT should already be running
@@ -389,45 +1147,55 @@ ReWireError RWDEFQuitPanelApp() {
  *
  ******************************************************************************/
 
-static void MakePlayEvent(ReWireDriveAudioOutputParams *outputParams, ReWireEvent *event)
-{
-	ReWireConvertToRequestPlayEvent(event);
+static int32_t FramesToPPQ15360(int32_t frames, uint32_t tempo) {
+	// tempo is in BPM * 1000
+	return static_cast<int32_t>((double)frames * tempo * 15360.0 / (60000.0 * g_AudioInfo.fSampleRate));
+}
 
-    // Force set the BPM
-	ReWireRequestTempoEvent *tempoEvent = ReWireConvertToRequestTempoEvent(
-        &outputParams->fEventOutBuffer.fEventBuffer[outputParams->fEventOutBuffer.fCount]
-    );
-	tempoEvent->fTempo = reinterpret_cast<MPTPlayRequest*>(&g_IncomingEvent)->tempo;
-	outputParams->fEventOutBuffer.fCount++;
+// nullptr if the mixer's event buffer is full
+static ReWireEvent* NextOutputEvent(ReWireDriveAudioOutputParams *outputParams) {
+	ReWireEventBuffer& buffer = outputParams->fEventOutBuffer;
+	if (buffer.fCount >= buffer.fEventBufferSize || buffer.fCount >= MAX_EVENT_OUTPUT) {
+		MPTIncrementCounter(g_Timing->eventsDropped);
+		return nullptr;
+	}
+	return &buffer.fEventBuffer[buffer.fCount++];
 }
 
-static void MakeRepositionEvent(ReWireEvent *event) {
+static void MakeRepositionEvent(const ReWireDriveAudioInputParams *inputParams, ReWireDriveAudioOutputParams *outputParams, const PendingEvent& pending, int32_t framesLate) {
 
+	ReWireEvent *event = NextOutputEvent(outputParams);
+	if (!event) return;
 	ReWireRequestRepositionEvent *repositionEvent = ReWireConvertToRequestRepositionEvent(event);
-	MPTRepositionRequest *req = reinterpret_cast<MPTRepositionRequest *>(g_IncomingEvent);
-	repositionEvent->fPPQ15360Pos = req->position15360PPQ;
 
-	// Make up for latency between now (when COM pipe is read) and when the event was issued at mix-time
-	/*LARGE_INTEGER ticksNow;
-	QueryPerformanceCounter(&ticksNow);
-	double diffInSeconds = (ticksNow.QuadPart - req->timeIssued.QuadPart) / (double)g_PerfFrequency.QuadPart;
-	int32_t offsetInPPQ15360 = static_cast<int32_t>(diffInSeconds / 60.0 * req->bpm * 15360);
+	// The mixer can only reposition on the next block boundary, by then the song has moved on from where the event was issued
+	int32_t offsetInPPQ15360 = FramesToPPQ15360(framesLate, inputParams->fTempo);
+	repositionEvent->fPPQ15360Pos = pending.value + offsetInPPQ15360;
+
+	DEBUG_PRINT("Repositioning, latency: %i frames\toffsetInPPQ15360: %i\n", (int)framesLate, (int)offsetInPPQ15360);
+}
 
-	DEBUG_PRINT(
-        "Repositioning, latency: %4.fms\toffsetInPPQ15360: %li\tBPM:%2.f\n",
-		(diffInSeconds * 1000.0), offsetInPPQ15360, req->bpm
-    );*/
+static void MakePlayEvent(ReWireDriveAudioOutputParams *outputParams) {
+	ReWireEvent *event = NextOutputEvent(outputParams);
+	if (event) ReWireConvertToRequestPlayEvent(event);
 }
 
-static void MakeTempoEvent(ReWireEvent *event) {
+static void MakeStopEvent(ReWireDriveAudioOutputParams *outputParams) {
+	ReWireEvent *event = NextOutputEvent(outputParams);
+	if (event) ReWireConvertToRequestStopEvent(event);
+}
+
+static void MakeTempoEvent(ReWireDriveAudioOutputParams *outputParams, const PendingEvent& pending) {
+	ReWireEvent *event = NextOutputEvent(outputParams);
+	if (!event) return;
 	ReWireRequestTempoEvent *tempoEvent = ReWireConvertToRequestTempoEvent(event);
-	tempoEvent->fTempo = *reinterpret_cast<uint32_t *>(&g_IncomingEvent[1]);
+	tempoEvent->fTempo = pending.value;
 	DEBUG_PRINT("Changing tempo to %i.\n", tempoEvent->fTempo);
 }
 
 
 
-static void PollAndHandleEvents(ReWireDriveAudioOutputParams *outputParams) {
+static void ReadIncomingEvents() {
     for (;;) {
 		uint16_t messageSize;
 		ReWireError status = RWDComRead(g_DevicePortHandle, PIPE_EVENTS, &messageSize, g_IncomingEvent);
@@ -435,33 +1203,151 @@ static void PollAndHandleEvents(ReWireDriveAudioOutputParams *outputParams) {
 			break;
 		}
 
-		ReWireEvent *event = &outputParams->fEventOutBuffer.fEventBuffer[outputParams->fEventOutBuffer.fCount];
-		outputParams->fEventOutBuffer.fCount++;
-
         DEBUG_PRINT("Incoming event of type %i.\n", g_IncomingEvent[0]);
 
-        switch (g_IncomingEvent[0]) {
+		PendingEvent pending;
+		pending.type = g_IncomingEvent[0];
+		pending.value = 0;
+        switch (pending.type) {
 			case(uint8_t)MPTPanelEvent::Play:
-                MakePlayEvent(outputParams, event);
-				//ReWireConvertToRequestPlayEvent(event);
+				if(messageSize < sizeof(MPTPlayRequest)) continue;
+				pending.value = reinterpret_cast<MPTPlayRequest *>(g_IncomingEvent)->tempo;
 				break;
 			case(uint8_t)MPTPanelEvent::Stop:
-				ReWireConvertToRequestStopEvent(event);
+				if(messageSize < sizeof(MPTEventRequest)) continue;
 				break;
 			case(uint8_t)MPTPanelEvent::ChangeBPM:
-				MakeTempoEvent(event);
+				if(messageSize < sizeof(MPTTempoRequest)) continue;
+				pending.value = reinterpret_cast<MPTTempoRequest *>(g_IncomingEvent)->tempo;
 				break;
 			case(uint8_t)MPTPanelEvent::Reposition:
-				MakeRepositionEvent(event);  
+				if(messageSize < sizeof(MPTRepositionRequest)) continue;
+				pending.value = reinterpret_cast<MPTRepositionRequest *>(g_IncomingEvent)->position15360PPQ;
 				break;
 
             // @TODO: loop start/stop events
 			default:
-				outputParams->fEventOutBuffer.fCount--; // effectively cancels event
+				continue;
         }
+		pending.framePosition = reinterpret_cast<MPTEventRequest *>(g_IncomingEvent)->framePosition;
 
+		if(MAX_PENDING_EVENTS == g_PendingEventCount) {
+			DEBUG_PRINT("Too many pending events, dropping event of type %i.\n", (int)pending.type);
+			MPTIncrementCounter(g_Timing->eventsDropped);
+			continue;
+		}
+		g_PendingEvents[g_PendingEventCount++] = pending;
     }
+}
+
+
+// An event that is due in the current block, and which of its parts survive coalescing
+typedef struct
+{
+	PendingEvent pending;
+	int32_t framesLate;
+	bool transport;  // Play or Stop
+	bool value;      // the tempo of Play and ChangeBPM, the position of Reposition
+} DueEvent;
 
+/**
+ * Within one block only the last transport change, the last tempo and the last reposition matter to the mixer.
+ * A tempo slide in OpenMPT sends a ChangeBPM for every tick, and Stop, Reposition, Play is how the song is
+ * restarted somewhere else; the mixer gets a single event of each kind instead, at the place of the last one.
+ * Returns the number of mixer events saved.
+**/
+static int CoalesceDueEvents(DueEvent* due, int dueCount) {
+	bool transportSeen = false, tempoSeen = false, repositionSeen = false;
+	int merged = 0;
+	for (int i = dueCount - 1; i >= 0; i--) {
+		DueEvent& event = due[i];
+		event.transport = event.value = false;
+		switch (event.pending.type) {
+			case(uint8_t)MPTPanelEvent::Play:
+				event.transport = !transportSeen;
+				event.value = !tempoSeen;
+				merged += transportSeen + tempoSeen;
+				transportSeen = tempoSeen = true;
+				break;
+			case(uint8_t)MPTPanelEvent::Stop:
+				event.transport = !transportSeen;
+				merged += transportSeen;
+				transportSeen = true;
+				break;
+			case(uint8_t)MPTPanelEvent::ChangeBPM:
+				event.value = !tempoSeen;
+				merged += tempoSeen;
+				tempoSeen = true;
+				break;
+			case(uint8_t)MPTPanelEvent::Reposition:
+				event.value = !repositionSeen;
+				merged += repositionSeen;
+				repositionSeen = true;
+				break;
+		}
+	}
+	return merged;
+}
+
+// Pending events are timestamped on the timeline of the panel that sent them, which starts over with the next one.
+// They would never fall due there and only take up the slots.
+static void ForgetPanelSession() {
+	g_PendingEventCount = 0;
+	g_PanelBlockEndKnown = false;
+}
+
+/**
+ * Hands the events that fall into the panel block we just uploaded (or into an earlier one) to the mixer.
+ * Events timestamped for later blocks stay pending.
+**/
+static void PollAndHandleEvents(const ReWireDriveAudioInputParams *inputParams, ReWireDriveAudioOutputParams *outputParams, uint32_t panelBlockEnd) {
+	// The panel's render position only moves backwards when a new panel took over without us noticing a disconnect;
+	// its events are still in the pipe
+	if (g_PanelBlockEndKnown && static_cast<int32_t>(panelBlockEnd - g_LastPanelBlockEnd) < 0) {
+		DEBUG_PRINT("DEVICE: Render position went back from %u to %u, dropping %i pending events.\n", g_LastPanelBlockEnd, panelBlockEnd, g_PendingEventCount);
+		ForgetPanelSession();
+	}
+	g_LastPanelBlockEnd = panelBlockEnd;
+	g_PanelBlockEndKnown = true;
+	ReadIncomingEvents();
+
+	DueEvent due[MAX_PENDING_EVENTS];
+	int dueCount = 0;
+	int keptEventCount = 0;
+	for (int i = 0; i < g_PendingEventCount; i++) {
+		const PendingEvent& pending = g_PendingEvents[i];
+		int32_t framesLate = static_cast<int32_t>(panelBlockEnd - pending.framePosition);
+		if (framesLate <= 0) {
+			g_PendingEvents[keptEventCount++] = pending;
+			continue;
+		}
+		due[dueCount].pending = pending;
+		due[dueCount++].framesLate = framesLate;
+	}
+	g_PendingEventCount = keptEventCount;
+	if (!dueCount) return;
+
+	const int merged = CoalesceDueEvents(due, dueCount);
+	if (merged) MPTAddToCounter(g_Timing->eventsMerged, merged);
+
+	for (int i = 0; i < dueCount; i++) {
+		const DueEvent& event = due[i];
+        switch (event.pending.type) {
+			case(uint8_t)MPTPanelEvent::Play:
+				if (event.transport) MakePlayEvent(outputParams);
+				if (event.value) MakeTempoEvent(outputParams, event.pending);  // forces the BPM
+				break;
+			case(uint8_t)MPTPanelEvent::Stop:
+				if (event.transport) MakeStopEvent(outputParams);
+				break;
+			case(uint8_t)MPTPanelEvent::ChangeBPM:
+				if (event.value) MakeTempoEvent(outputParams, event.pending);
+				break;
+			case(uint8_t)MPTPanelEvent::Reposition:
+				if (event.value) MakeRepositionEvent(inputParams, outputParams, event.pending, event.framesLate);
+				break;
+        }
+	}
 }
 
 
@@ -0,0 +1,234 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "MPTRewireMemory.h"
+#include <atomic>
+#include <string.h>
+
+
+static std::atomic<uint64_t> g_LockedBytes(0);
+static std::atomic<uint64_t> g_UnlockedBytes(0);
+static std::atomic<uint64_t> g_HugePageBytes(0);
+
+static void AccountMemory(size_t size, bool locked, bool hugePages, bool add)
+{
+	std::atomic<uint64_t> &bytes = locked ? g_LockedBytes : g_UnlockedBytes;
+	if(add) bytes.fetch_add(size, std::memory_order_relaxed);
+	else bytes.fetch_sub(size, std::memory_order_relaxed);
+	if(!hugePages) return;
+	if(add) g_HugePageBytes.fetch_add(size, std::memory_order_relaxed);
+	else g_HugePageBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+static inline size_t RoundUp(size_t size, size_t granularity)
+{
+	return (size + granularity - 1) / granularity * granularity;
+}
+
+
+
+/*******************************************************************************
+ *
+ * Windows
+ *
+ ******************************************************************************/
+
+#ifdef _WIN32
+
+static size_t PageSize()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
+static bool LockPages(void *data, size_t size)
+{
+	if(VirtualLock(data, size)) return true;
+	if(ERROR_WORKING_SET_QUOTA != GetLastError()) return false;
+
+	// What a process may lock is bounded by its minimum working set, grow it by what we need
+	SIZE_T minimum = 0, maximum = 0;
+	if(!GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum)) return false;
+	minimum += size;
+	if(maximum < minimum) maximum = minimum;
+	if(!SetProcessWorkingSetSize(GetCurrentProcess(), minimum, maximum)) return false;
+	return 0 != VirtualLock(data, size);
+}
+
+static void UnlockPages(void *data, size_t size)
+{
+	VirtualUnlock(data, size);
+}
+
+
+bool MPTLockedBuffer::allocate(size_t size)
+{
+	free();
+	if(!size) return false;
+
+	// Large pages are never paged out, but need SeLockMemoryPrivilege, which hardly any user holds
+	const size_t largePage = GetLargePageMinimum();
+	if(largePage && size >= MPT_HUGE_PAGE_MIN_SIZE)
+	{
+		const size_t rounded = RoundUp(size, largePage);
+		m_Data = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if(m_Data)
+		{
+			m_Size = rounded;
+			m_Locked = m_HugePages = true;
+		}
+	}
+	if(!m_Data)
+	{
+		m_Size = RoundUp(size, PageSize());
+		m_Data = VirtualAlloc(NULL, m_Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if(!m_Data)
+		{
+			m_Size = 0;
+			return false;
+		}
+		memset(m_Data, 0, m_Size);
+		m_Locked = LockPages(m_Data, m_Size);
+	}
+	AccountMemory(m_Size, m_Locked, m_HugePages, true);
+	return true;
+}
+
+void MPTLockedBuffer::free()
+{
+	if(!m_Data) return;
+	AccountMemory(m_Size, m_Locked, m_HugePages, false);
+	VirtualFree(m_Data, 0, MEM_RELEASE);  // unlocks as well
+	m_Data = nullptr;
+	m_Size = 0;
+	m_Locked = m_HugePages = false;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * POSIX
+ *
+ ******************************************************************************/
+
+#else
+
+static size_t PageSize()
+{
+	const long pageSize = sysconf(_SC_PAGESIZE);
+	return pageSize > 0 ? (size_t)pageSize : 4096;
+}
+
+static bool LockPages(void *data, size_t size)
+{
+	// Bounded by RLIMIT_MEMLOCK unless we have CAP_IPC_LOCK
+	return 0 == mlock(data, size);
+}
+
+static void UnlockPages(void *data, size_t size)
+{
+	munlock(data, size);
+}
+
+
+bool MPTLockedBuffer::allocate(size_t size)
+{
+	free();
+	if(!size) return false;
+
+#ifdef MAP_HUGETLB
+	// Only succeeds if the administrator reserved huge pages, which are never swapped out
+	if(size >= MPT_HUGE_PAGE_MIN_SIZE)
+	{
+		const size_t rounded = RoundUp(size, MPT_HUGE_PAGE_MIN_SIZE);
+		void *data = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(MAP_FAILED != data)
+		{
+			m_Data = data;
+			m_Size = rounded;
+			m_Locked = m_HugePages = true;
+			memset(m_Data, 0, m_Size);
+		}
+	}
+#endif
+	if(!m_Data)
+	{
+		m_Size = RoundUp(size, PageSize());
+		void *data = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(MAP_FAILED == data)
+		{
+			m_Size = 0;
+			return false;
+		}
+		m_Data = data;
+#ifdef MADV_HUGEPAGE
+		// Transparent huge pages are a hint only, so they do not count towards hugePageBytes
+		if(m_Size >= MPT_HUGE_PAGE_MIN_SIZE) madvise(m_Data, m_Size, MADV_HUGEPAGE);
+#endif
+		// Writing faults in private pages of our own rather than the shared zero page
+		memset(m_Data, 0, m_Size);
+		m_Locked = LockPages(m_Data, m_Size);
+	}
+	AccountMemory(m_Size, m_Locked, m_HugePages, true);
+	return true;
+}
+
+void MPTLockedBuffer::free()
+{
+	if(!m_Data) return;
+	AccountMemory(m_Size, m_Locked, m_HugePages, false);
+	munmap(m_Data, m_Size);  // unlocks as well
+	m_Data = nullptr;
+	m_Size = 0;
+	m_Locked = m_HugePages = false;
+}
+
+#endif
+
+
+
+
+/*******************************************************************************
+ *
+ * Existing mappings
+ *
+ ******************************************************************************/
+
+bool MPTLockMemory(void *data, size_t size)
+{
+	if(!data || !size) return false;
+	const bool locked = LockPages(data, size);
+	if(!locked) MPTPrefaultMemory(data, size);  // at least fault everything in now
+	AccountMemory(size, locked, false, true);
+	return locked;
+}
+
+void MPTPrefaultMemory(const void *data, size_t size)
+{
+	// Reading only: the other side may already be writing to shared memory
+	const volatile uint8_t *bytes = static_cast<const volatile uint8_t *>(data);
+	const size_t pageSize = PageSize();
+	for(size_t offset = 0; data && offset < size; offset += pageSize)
+		(void)bytes[offset];
+}
+
+void MPTUnlockMemory(void *data, size_t size, bool locked)
+{
+	if(!data || !size) return;
+	if(locked) UnlockPages(data, size);
+	AccountMemory(size, locked, false, false);
+}
+
+void MPTGetLockedMemoryStats(MPTLockedMemoryStats &stats)
+{
+	stats.lockedBytes = g_LockedBytes.load(std::memory_order_relaxed);
+	stats.unlockedBytes = g_UnlockedBytes.load(std::memory_order_relaxed);
+	stats.hugePageBytes = g_HugePageBytes.load(std::memory_order_relaxed);
+}
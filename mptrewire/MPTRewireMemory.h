@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory for the audio path that is resident before the first block and stays resident.
+// Pages are touched up front and locked into RAM, VirtualLock on Windows and mlock elsewhere, so that neither
+// a first touch nor the pager can cost us a page fault on the real-time thread. Large buffers try huge pages first.
+// Nothing here needs privileges to succeed; what could not be locked is still prefaulted and shows up in the stats.
+
+#define MPT_HUGE_PAGE_MIN_SIZE (2 * 1024 * 1024)  // buffers below this are not worth a huge page
+
+
+// Process-wide, every locked buffer and mapping counts
+typedef struct
+{
+	uint64_t lockedBytes;    // resident and locked
+	uint64_t unlockedBytes;  // prefaulted only, the lock was refused
+	uint64_t hugePageBytes;  // part of lockedBytes that sits on huge pages
+} MPTLockedMemoryStats;
+
+
+// For memory that is already mapped, e.g. shared memory. Returns whether the lock succeeded,
+// which has to be handed back to MPTUnlockMemory() before the memory is unmapped.
+bool MPTLockMemory(void *data, size_t size);
+void MPTUnlockMemory(void *data, size_t size, bool locked);
+// For a mapping of shared memory another process keeps locked: only faults our view of it in, reading only
+void MPTPrefaultMemory(const void *data, size_t size);
+void MPTGetLockedMemoryStats(MPTLockedMemoryStats &stats);
+
+
+// Page-aligned, zeroed, prefaulted and if at all possible locked
+class MPTLockedBuffer
+{
+private:
+	void *m_Data = nullptr;
+	size_t m_Size = 0;  // as mapped, rounded up to the page size
+	bool m_Locked = false;
+	bool m_HugePages = false;
+
+public:
+	MPTLockedBuffer() = default;
+	MPTLockedBuffer(const MPTLockedBuffer &) = delete;
+	MPTLockedBuffer &operator=(const MPTLockedBuffer &) = delete;
+	~MPTLockedBuffer() { free(); }
+
+	bool allocate(size_t size);
+	void free();
+
+	uint8_t *data() const { return static_cast<uint8_t *>(m_Data); }
+	size_t size() const { return m_Size; }
+	bool isLocked() const { return m_Locked; }
+	bool usesHugePages() const { return m_HugePages; }
+};
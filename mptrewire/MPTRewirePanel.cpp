@@ -5,9 +5,11 @@
 #include "ReWireAPI.h"
 #include "ReWirePanelAPI.h"
 #include "MPTRewirePanel.h"
+#include "MPTRewireAudioKernels.h"
 #include "MPTRewireDebugUtils.h"
 #include "../../mptrack/Reporting.h"
 #include <algorithm>
+#include <new>
 #include <thread>
 #include <string.h>
 #include <stdlib.h>
@@ -17,6 +19,9 @@
 using namespace ReWire;
 
 
+#define SEND_RETRY_TIMEOUT_MS 100  // how long a bounce, or a block with credits, keeps retrying a message the pipe has no room for
+
+
 static std::string getExecutableDirectory() {
 	char buffer[MAX_PATH];
 	GetModuleFileNameA(NULL, buffer, MAX_PATH);
@@ -36,6 +41,9 @@ static std::string getExecutableDirectory() {
 
 MPTRewirePanel::MPTRewirePanel()
 {
+	// xorshift noise must not start out at zero
+	for(int i = 0; i < MPT_DITHER_LANES; i++)
+		m_DitherState[i] = 0x9E3779B9u * (uint32_t)(i + 1);
 
 	// Open ReWire
 	ReWireError status = RWPOpen();
@@ -59,8 +67,18 @@ MPTRewirePanel::MPTRewirePanel()
 		return;
 	}
 
-	// Make sure there are allocated audio buffers at all times
-	reallocateBuffers(8192);
+	// Make sure there are allocated audio buffers at all times, the audio thread only swaps in bigger ones
+	MPTDefaultRoutingMap(m_Routing);
+	useRouting(m_Routing);
+	m_AllocatedCapacity = MPT_PANEL_INITIAL_CAPACITY;
+	m_AllocatedRouting = m_RoutedSources;
+	useBuffers(allocateBuffers(m_AllocatedCapacity, m_AllocatedRouting));
+	if(!m_ControlMemory.allocate(MPT_PANEL_MESSAGE_SIZE + MPT_MAX_BATCH_SIZE)) throw std::bad_alloc();
+	m_Message = m_ControlMemory.data();
+	m_BatchBuffer = m_ControlMemory.data() + MPT_PANEL_MESSAGE_SIZE;
+	if(!m_ControlMemory.isLocked() || !m_Buffers->arena.isLocked())
+		DEBUG_PRINT("Audio buffers could not be locked into memory, they are prefaulted only\n");
+	MPTResetPanelTiming(m_Timing);
 
 }
 
@@ -87,6 +105,7 @@ MPTPanelStatus MPTRewirePanel::open(
 	// Load the device
 	// DEBUG_PRINT("Loading ReWire device at \"%s\".\n", deviceDllPath.c_str());
 	m_EventToDevice = CreateEventA(NULL, FALSE, FALSE, "OPENMPT_REWIRE_PANEL_TO_DEVICE");
+	m_SignalToDevice.setEvent(m_EventToDevice);
 	status = RWPLoadDevice(m_DeviceName);
 	if (kReWireError_UnableToOpenDevice == status) {
 		return MPTPanelStatus::UnknownDeviceProblem;
@@ -103,6 +122,7 @@ MPTPanelStatus MPTRewirePanel::open(
 		DEBUG_PRINT("OpenEventA failed, error=%i.\n", (int)GetLastError());
 		return MPTPanelStatus::UnknownDeviceProblem;
 	}
+	m_SignalFromDevice.setEvent(m_EventFromDevice);
 
 	status = RWPComConnect("OMPT", &m_PanelPortHandle);
 	if(status != kReWireError_NoError) // @TODO: kReWireError_Busy (I think when connecting after mixer quit)
@@ -111,6 +131,57 @@ MPTPanelStatus MPTRewirePanel::open(
 		return MPTPanelStatus::ReWireProblem;
 	}
 
+	// Map the device's control region, which also carries its statistics.
+	// If that fails we simply keep sending audio through the COM pipe, with a handshake for every message.
+	if(!m_Control.open(MPT_SHARED_CONTROL_NAME))
+	{
+		DEBUG_PRINT("Unable to map shared control region, falling back to COM pipe.\n");
+	}
+	setRenderAhead(m_RenderAhead);
+	setRenderQuantum(m_RenderQuantum);
+
+	// The device settled the routing when the mixer loaded it. Only without its control region we read the map ourselves.
+	MPTRoutingMap routing;
+	MPTDefaultRoutingMap(routing);
+	if(m_Control.isOpen())
+	{
+		routing = m_Control.header()->routing;
+	} else
+	{
+		char path[MAX_PATH + sizeof(MPT_ROUTING_MAP_FILE)];
+		routingMapPath(path, sizeof(path));
+		MPTLoadRoutingMap(path, routing);
+	}
+	useRouting(routing);
+
+	// The device also tells us how large the mixer's blocks get, so that the first ones need not wait for the allocator
+	int32_t capacity = m_AllocatedCapacity;
+	if(m_Control.isOpen())
+	{
+		const uint32_t maxBufferSize = m_Control.header()->maxBufferSize.load(std::memory_order_relaxed);
+		if(maxBufferSize) capacity = (int32_t)maxBufferSize;
+	}
+	if(m_RoutedSources != m_AllocatedRouting || capacity != m_AllocatedCapacity)
+	{
+		// Neither the audio thread nor the allocator runs yet, so the buffers can be replaced right here
+		freeBuffers(m_PendingBuffers.exchange(nullptr));
+		freeBuffers(m_Buffers);
+		m_AllocatedRouting = m_RoutedSources;
+		m_AllocatedCapacity = capacity;
+		useBuffers(allocateBuffers(m_AllocatedCapacity, m_AllocatedRouting));
+	}
+	if(m_Control.isOpen()) m_Control.header()->offlineDetection.store(m_OfflineDetection ? 1 : 0, std::memory_order_relaxed);
+	useSharedSignals();
+
+	// The audio ring is only there for the shared-memory transport. The device creates it once we ask for it,
+	// on the mixer's idle thread; until it is mapped blocks take the COM pipe.
+	m_AudioRingFailed = false;
+	if(m_UseSharedMemory && m_Control.isOpen())
+	{
+		m_Control.header()->audioRingRequested.store(1, std::memory_order_relaxed);
+		mapAudioRing();
+	}
+
 	// Start audio thread
 	m_CallbackUserData = callbackUserData;
 	m_RenderCallback = renderCallback;
@@ -118,6 +189,13 @@ MPTPanelStatus MPTRewirePanel::open(
 	m_MixerQuitCallback = mixerQuitCallback;
 	m_MixerQuit = false;
 	m_Running = true;
+	if(m_GroupRenderCallback)
+	{
+		MPTThreadOptions workerOptions = m_ThreadOptions;
+		workerOptions.affinityMask = m_WorkerAffinityMask;
+		m_RenderPool.start(m_RenderWorkers, workerOptions);
+	}
+	startAllocator();
 	m_Thread = std::thread(&MPTRewirePanel::threadProc, this);
 	return MPTPanelStatus::Ok;
 }
@@ -144,7 +222,21 @@ bool MPTRewirePanel::close()
 	if(!m_Running) return true;
 	m_Running = false;
 	if(m_Thread.joinable()) m_Thread.join();
+	m_RenderPool.stop();
+	stopAllocator();
 	CloseHandle(m_EventToDevice);
+	if(m_Control.isOpen())
+	{
+		m_Control.header()->requestedRenderAhead.store(0, std::memory_order_relaxed);
+		m_Control.header()->requestedRenderQuantum.store(0, std::memory_order_relaxed);
+		m_Control.header()->offlineRenderAhead.store(0, std::memory_order_relaxed);
+		m_Control.header()->panelUsesSignals.store(0, std::memory_order_release);
+	}
+	m_SignalToDevice.setSignal(nullptr);
+	m_SignalFromDevice.setSignal(nullptr);
+	m_AudioRingReady.store(false, std::memory_order_relaxed);
+	m_AudioRing.close();
+	m_Control.close();
 
 	ReWireError status = RWPComDisconnect(m_PanelPortHandle);
 	if(kReWireError_NoError != status)
@@ -173,11 +265,26 @@ bool MPTRewirePanel::close()
 **/
 void MPTRewirePanel::threadProc()
 {
+	// Render at real-time priority if asked to; the thread runs at whatever it was granted
+	void *revertToken = nullptr;
+	const MPTSchedulingClass schedulingClass = MPTEnterRealTime(m_ThreadOptions, &revertToken);
+	const bool pinned = MPTSetThreadAffinity(m_ThreadOptions.affinityMask);
+	if(m_ThreadOptions.realTime && MPTSchedulingClass::Normal == schedulingClass)
+		DEBUG_PRINT("Unable to raise the audio thread's priority, rendering at normal priority.\n");
+	if(m_ThreadOptions.affinityMask && !pinned)
+		DEBUG_PRINT("Unable to set the audio thread's affinity to %llx.\n", (unsigned long long)m_ThreadOptions.affinityMask);
+	m_SchedulingClass.store(schedulingClass, std::memory_order_relaxed);
+	m_ThreadPinned.store(pinned, std::memory_order_relaxed);
+
 	while(m_Running)
 	{
 		checkComConnection();
 		pollAudioRequests();
 	}
+
+	MPTLeaveRealTime(revertToken);
+	m_SchedulingClass.store(MPTSchedulingClass::Normal, std::memory_order_relaxed);
+	m_ThreadPinned.store(false, std::memory_order_relaxed);
 }
 
 
@@ -188,32 +295,160 @@ void MPTRewirePanel::threadProc()
  * 
  ******************************************************************************/
 
+/**
+ * All pipe channels of a set live in one arena. Each one starts on a cache line and is preceded by a cache line
+ * whose tail holds its MPTAudioResponse, so a rendered channel is sent as a message without being copied.
+ * The one the unrouted channels share comes first, then one for every routed channel. A channel cannot get its buffer
+ * later, once it is first rendered: the render callback writes to where m_AudioBuffers points before we know.
+ *
+ *   [ pad | MPTAudioResponse ][ discard ][ pad | MPTAudioResponse ][ channel 0 ][ pad | MPTAudioResponse ][ channel 3 ] ...
+**/
+static_assert(sizeof(MPTAudioResponse) <= MPT_CACHE_LINE_SIZE, "MPTAudioResponse must fit in front of a channel");
+static_assert(kReWireAudioChannelCount / 2 == MPT_ROUTING_SOURCES, "Routed sources are a 64-bit mask of stereo channels");
+
+MPTPanelBuffers *MPTRewirePanel::allocateBuffers(int32_t capacity, uint64_t routedSources)
+{
+	MPTPanelBuffers *buffers = new MPTPanelBuffers();
+	buffers->capacity = capacity;
+	size_t channelSize = (size_t)capacity * 2 * sizeof(int32_t);
+	channelSize = (channelSize + MPT_CACHE_LINE_SIZE - 1) & ~(size_t)(MPT_CACHE_LINE_SIZE - 1);
+	const size_t channelStride = MPT_CACHE_LINE_SIZE + channelSize;
+	size_t slotCount = 1;
+	for(uint64_t sources = routedSources; sources; sources &= sources - 1) slotCount++;
+	if(!buffers->arena.allocate(channelStride * slotCount))
+	{
+		delete buffers;
+		throw std::bad_alloc();
+	}
+
+	size_t slot = 1;
+	for(int i = 0; i < kReWireAudioChannelCount / 2; i++)
+	{
+		// The MPTAudioResponse in front of a buffer is filled in when a bus is sent from it
+		const size_t channelSlot = (routedSources & ((uint64_t)1 << i)) ? slot++ : 0;
+		uint8_t *channel = buffers->arena.data() + channelSlot * channelStride + MPT_CACHE_LINE_SIZE;
+		buffers->audioBuffers[i] = buffers->pipeAudioBuffers[i] = reinterpret_cast<int *>(channel);
+	}
+	return buffers;
+}
+
+void MPTRewirePanel::freeBuffers(MPTPanelBuffers *buffers)
+{
+	while(buffers)
+	{
+		MPTPanelBuffers *next = buffers->nextRetired;
+		delete buffers;
+		buffers = next;
+	}
+}
+
 void MPTRewirePanel::deallocateBuffers() {
-	if(m_AudioBuffers)
+	freeBuffers(m_PendingBuffers.exchange(nullptr));
+	freeBuffers(m_RetiredBuffers.exchange(nullptr));
+	freeBuffers(m_Buffers);
+	useBuffers(nullptr);
+	m_ControlMemory.free();
+	m_Message = nullptr;
+	m_BatchBuffer = nullptr;
+}
+
+
+void MPTRewirePanel::useBuffers(MPTPanelBuffers *buffers)
+{
+	m_Buffers = buffers;
+	m_PipeAudioBuffers = buffers ? buffers->pipeAudioBuffers : nullptr;
+	m_AudioBuffers = buffers ? buffers->audioBuffers : nullptr;
+}
+
+
+
+/**
+ * The audio thread never allocates or frees heap memory once it runs. When the mixer grows its buffers, the
+ * allocator thread prepares a bigger set and the audio thread swaps it in between two blocks. The set it drops
+ * can no longer be referenced by anyone, since only the audio thread and the render callbacks it runs use it,
+ * so it is handed back to the allocator to be freed whenever that gets around to it.
+ * Sets are sized to the mixer's maximum buffer size, so they shrink along with it, and only hold the routed channels.
+**/
+void MPTRewirePanel::adoptPendingBuffers()
+{
+	MPTPanelBuffers *pending = m_PendingBuffers.exchange(nullptr, std::memory_order_acquire);
+	if(!pending) return;
+	retireBuffers(m_Buffers);
+	useBuffers(pending);
+}
+
+void MPTRewirePanel::retireBuffers(MPTPanelBuffers *buffers)
+{
+	if(!buffers) return;
+	buffers->nextRetired = m_RetiredBuffers.load(std::memory_order_relaxed);
+	while(!m_RetiredBuffers.compare_exchange_weak(buffers->nextRetired, buffers, std::memory_order_release, std::memory_order_relaxed)) {}
+	m_AllocatorWakeup.notify_one();
+}
+
+void MPTRewirePanel::requestBufferCapacity(int32_t capacity)
+{
+	m_RequestedCapacity.store(capacity, std::memory_order_release);
+	m_AllocatorWakeup.notify_one();
+}
+
+
+void MPTRewirePanel::startAllocator()
+{
+	m_AllocatorQuit = false;
+	m_AllocatorThread = std::thread(&MPTRewirePanel::allocatorProc, this);
+}
+
+void MPTRewirePanel::stopAllocator()
+{
 	{
-		for(int i = 0; i < kReWireAudioChannelCount / 2; i++)
-			if(m_AudioBuffers[i])
-				delete[] m_AudioBuffers[i];
-		delete[] m_AudioBuffers;
-		m_AudioBuffers = nullptr;
+		std::lock_guard<std::mutex> lock(m_AllocatorMutex);
+		m_AllocatorQuit = true;
 	}
-	if(m_AudioResponseBuffer)
+	m_AllocatorWakeup.notify_all();
+	if(m_AllocatorThread.joinable()) m_AllocatorThread.join();
+}
+
+void MPTRewirePanel::allocatorProc()
+{
+	std::unique_lock<std::mutex> lock(m_AllocatorMutex);
+	while(!m_AllocatorQuit)
 	{
-		delete[] m_AudioResponseBuffer;
-		m_AudioResponseBuffer = nullptr;
+		// The audio thread notifies without taking the lock, so a wakeup may get lost; polling makes up for it
+		m_AllocatorWakeup.wait_for(lock, std::chrono::milliseconds(100), [this] {
+			return m_AllocatorQuit || m_RequestedCapacity.load(std::memory_order_relaxed) || m_RetiredBuffers.load(std::memory_order_relaxed);
+		});
+
+		freeBuffers(m_RetiredBuffers.exchange(nullptr, std::memory_order_acquire));
+		const int32_t requestedCapacity = m_RequestedCapacity.exchange(0, std::memory_order_acquire);
+		const int32_t capacity = requestedCapacity ? requestedCapacity : m_AllocatedCapacity;
+		if(capacity != m_AllocatedCapacity)
+		{
+			// A set the audio thread has not picked up yet was never used, so it can go right away
+			DEBUG_PRINT("Allocating audio buffers for %i frames.\n", capacity);
+			freeBuffers(m_PendingBuffers.exchange(allocateBuffers(capacity, m_AllocatedRouting), std::memory_order_acq_rel));
+			m_AllocatedCapacity = capacity;
+		}
+		mapAudioRing();
 	}
 }
 
 
-void MPTRewirePanel::reallocateBuffers(int32_t maxBufferSize)
+/**
+ * Maps the audio ring once the device has created it, off the audio thread, which picks it up through
+ * m_AudioRingReady. It stays mapped until close(), the audio thread may be rendering into a slot at any time.
+**/
+void MPTRewirePanel::mapAudioRing()
 {
-	m_MaxBufferSize = maxBufferSize;
+	if(!m_UseSharedMemory || m_AudioRingFailed || !m_Control.isOpen() || m_AudioRingReady.load(std::memory_order_relaxed)) return;
+	if(!m_Control.header()->audioRingReady.load(std::memory_order_acquire)) return;
 
-	deallocateBuffers();
-	m_AudioBuffers = new int *[kReWireAudioChannelCount / 2];
-	for(int i = 0; i < kReWireAudioChannelCount / 2; i++)
-		m_AudioBuffers[i] = new int[(size_t)m_MaxBufferSize * 2];
-	m_AudioResponseBuffer = reinterpret_cast<MPTAudioResponse *>(new uint8_t[sizeof(MPTAudioResponse) + ((size_t)m_MaxBufferSize * 2 * sizeof(int32_t))]);
+	if(!m_AudioRing.open(MPT_SHARED_RING_NAME))
+	{
+		DEBUG_PRINT("Unable to map shared audio ring, staying with the COM pipe.\n");
+		m_AudioRingFailed = true;  // do not try again every time
+		return;
+	}
+	m_AudioRingReady.store(true, std::memory_order_release);
 }
 
 
@@ -248,15 +483,39 @@ void MPTRewirePanel::swallowRemainingMessages()
 }
 
 
+/**
+ * Wake each other through the words in the shared region from now on. Called before the audio thread starts,
+ * the device picks it up on its next callback.
+**/
+void MPTRewirePanel::useSharedSignals()
+{
+	if(!m_Control.isOpen()) return;
+	MPTSharedControlHeader *header = m_Control.header();
+
+	// Nobody uses the signals right now, so leftovers of a previous session can be cleared
+	header->signalToPanel.state.store(MPT_SIGNAL_EMPTY, std::memory_order_relaxed);
+	header->signalToDevice.state.store(MPT_SIGNAL_EMPTY, std::memory_order_relaxed);
+	header->spinWaitEnabled.store(m_SpinWait ? 1 : 0, std::memory_order_relaxed);
+	m_SignalToDevice.setSignal(&header->signalToDevice);
+	m_SignalFromDevice.setSignal(&header->signalToPanel);
+	m_SignalFromDevice.enableSpinning(m_SpinWait);
+	header->panelUsesSignals.store(1, std::memory_order_release);
+}
+
+
 bool MPTRewirePanel::waitForEventFromDevice(const int milliseconds)
 {
-	switch(WaitForSingleObject(m_EventFromDevice, milliseconds))
+	switch(m_SignalFromDevice.wait(milliseconds))
 	{
-		case WAIT_ABANDONED:
-		case WAIT_OBJECT_0:
+		case MPTWaitResult::Spun:
+			MPTIncrementCounter(m_Timing.spinHits);
+			return true;
+		case MPTWaitResult::Woken:
+			MPTIncrementCounter(m_Timing.kernelWaits);
 			return true;
-		case WAIT_TIMEOUT:
+		case MPTWaitResult::Timeout:
 			{
+				MPTIncrementCounter(m_Timing.kernelWaits);
 				// Detect if the mixer app has quit abruptly
 				ReWire_char_t isRunning = 0;
 				if(kReWireError_NoError != RWPIsReWireMixerAppRunning(&isRunning) || !isRunning)
@@ -269,7 +528,7 @@ bool MPTRewirePanel::waitForEventFromDevice(const int milliseconds)
 				}
 				break;
 			}
-		case WAIT_FAILED:  // 6 = INVALID_HANDLE
+		case MPTWaitResult::Failed:  // 6 = INVALID_HANDLE
 			DEBUG_PRINT("waitForEventFromDevice WAIT_FAILED, error=%i.\n", (int)GetLastError());
 	}
 	return false;  // timeout or error
@@ -289,80 +548,469 @@ void MPTRewirePanel::pollAudioRequests()
 	// Wait for the device to request audio from us
 	if(!waitForEventFromDevice()) return;
 
-	// Read requested audio buffer properties
+	// With render-ahead, several requests may be queued up behind a single wakeup and each one must be served
 	MPTAudioRequest request;
+	while(readAudioRequest(request))
+	{
+		adoptPendingBuffers();
+
+		// Handle changes in samplerate and buffer size
+		// This also happens after opening the panel to (re-)allocate the buffers
+		if(m_SampleRate != request.sampleRate || m_MaxBufferSize != request.maxBufferSize)
+		{
+			handleAudioInfoChange(request.sampleRate, request.maxBufferSize);
+		}
+		m_SignalFromDevice.setBlockDuration(request.framesToRender, request.sampleRate);
+
+		if(0 == request.renderAhead)
+		{
+			swallowRemainingMessages();
+			generateAudioAndUploadToDevice(request);
+			return;
+		}
+		generateAudioAndUploadToDevice(request);
+	}
+}
+
+
+
+bool MPTRewirePanel::readAudioRequest(MPTAudioRequest &request)
+{
+	// Read requested audio buffer properties
 	ReWire_uint16_t messageSize = 0;
 	ReWireError status = RWPComRead(m_PanelPortHandle, PIPE_RT, &messageSize, m_Message);
 	if(kReWireError_NoError != status)
 	{
 		if(kReWireError_NoMoreMessages != status)
 			DEBUG_PRINT("RWPComRead returned %i.\n", (int)status);
+		return false;
+	}
+
+	if(messageSize < sizeof(MPTAudioRequest)) return false;  // prevent potential access violation
+	memcpy(&request, m_Message, sizeof(MPTAudioRequest));
+	return true;
+}
+
+
+
+void MPTRewirePanel::generateAudioAndUploadToDevice(MPTAudioRequest request)
+{
+	const uint64_t startNs = MPTNowNs();
+
+	// Prefer rendering straight into the shared audio ring, which needs no messages per channel
+	if((request.capabilities & MPT_CAP_SHARED_MEMORY) && generateAudioIntoSharedMemory(request))
+	{
+		recordBlockTiming(startNs);
+		return;
+	}
+
+	// The device does not expect messages while rendering ahead; it restarts its pipeline if we skip a block
+	if(request.renderAhead)
+	{
+		MPTIncrementCounter(m_Timing.droppedBlocks);
+		return;
+	}
+
+	// The mixer outgrew our buffers and the allocator is not done yet. Tell the device that nothing was rendered,
+	// rather than letting it wait for us. As an empty batch the header needs no acknowledgement: the device would
+	// send that on the event its next request wakes us with, and we would miss that request.
+	if(request.framesToRender > (uint32_t)m_Buffers->capacity)
+	{
+		MPTIncrementCounter(m_Timing.droppedBlocks);
+		ReWireClearBitField(m_ServedChannelsBitfield, kReWireAudioChannelCount / 2);
+		ReWireClearBitField(m_SilentChannelsBitfield, kReWireAudioChannelCount / 2);
+		m_PackedFormat = 0;
+		if(request.capabilities & MPT_CAP_BATCHED)
+			sendAudioResponseHeaderToDevice(MPT_CAP_BATCHED | formatFlags(), false);
+		else
+			sendAudioResponseHeaderToDevice(formatFlags(), 0 == (request.capabilities & MPT_CAP_OFFLINE));
+		recordBlockTiming(startNs);
 		return;
 	}
 
-	if(messageSize < sizeof(MPTAudioRequest)) return;  // prevent potential access violation
-	memcpy(&request, m_Message, messageSize);
+	// Packing starts out from int32, so the channels must not be rendered as float
+	uint32_t packedFormat = 0;
+	if(MPTPayloadFormat::Packed24 == m_PayloadFormat) packedFormat = request.capabilities & MPT_CAP_PACKED24;
+	if(MPTPayloadFormat::Packed16 == m_PayloadFormat) packedFormat = request.capabilities & MPT_CAP_PACKED16;
+	if(packedFormat) request.capabilities &= ~MPT_CAP_FLOAT32;
 
-	// Handle changes in samplerate and buffer size
-	// This also happens after opening the panel to (re-)allocate the buffers
-	if(m_SampleRate != request.sampleRate || m_MaxBufferSize != request.maxBufferSize)
+	// Let OpenMPT render the audio channels
+	prepareSourceBuffers(nullptr);
+	renderAudio(request, nullptr);
+	m_PackedFormat = packedFormat;
+
+	// Send the whole block in a single message if it fits through the pipe
+	if((request.capabilities & MPT_CAP_BATCHED) && sendAudioBatchToDevice(request))
+	{
+		recordBlockTiming(startNs);
+		return;
+	}
+
+	// Inform the device that we are going to send audio packets.
+	// During a bounce the device does not acknowledge anything, we just keep the pipe filled.
+	// Otherwise we stream as many messages as the device granted credits for, the header being the first one.
+	const bool offline = (0 != (request.capabilities & MPT_CAP_OFFLINE));
+	m_Credits = (!offline && m_Control.isOpen()) ? request.credits : 0;
+	m_MessagesSent = 1;
+	sendAudioResponseHeaderToDevice(formatFlags() | (m_Credits ? MPT_CAP_CREDITS : 0), !offline && !m_Credits);
+
+	// Send response for each interleaved stereo channel, its MPTAudioResponse already precedes it in the arena
+	const size_t audioDataSize = (size_t)request.framesToRender * MPTPayloadFrameSize(m_PackedFormat);
+	int lastChannel = -1;
+	for(int channel = 0; channel < (int)m_BusCount; channel++)
 	{
-		handleAudioInfoChange(request.sampleRate, request.maxBufferSize);
+		if(ReWireIsBitInBitFieldSet(m_ServedChannelsBitfield, channel))
+			lastChannel = channel;
 	}
+	for(uint16_t channel = 0; channel < m_BusCount; channel++)
+	{
+
+		// Only serve rendered channels
+		if(!ReWireIsBitInBitFieldSet(m_ServedChannelsBitfield, channel))
+			continue;
 
-	swallowRemainingMessages();
-	generateAudioAndUploadToDevice(request);
+		if(!sendAudioChannelToDevice(channel, audioDataSize, channel == lastChannel, offline))
+		{
+			MPTIncrementCounter(m_Timing.failedBlocks);
+			break;
+		}
+	}
+	recordBlockTiming(startNs);
 }
 
 
 
-void MPTRewirePanel::generateAudioAndUploadToDevice(MPTAudioRequest request)
+/**
+ * Points every source at what it renders into: its pipe buffer, or for the first source of a bus the bus's
+ * channel in the shared audio ring slot, if there is one.
+ * Only the routed sources and the buses can point elsewhere after the previous block, the rest are left alone.
+**/
+void MPTRewirePanel::prepareSourceBuffers(MPTSharedRingSlot *slot)
 {
-	// Let OpenMPT render the audio channels
+	const uint64_t buses = (m_BusCount < MPT_ROUTING_SOURCES) ? ((uint64_t)1 << m_BusCount) - 1 : ~(uint64_t)0;
+	for(uint64_t sources = m_RoutedSources | buses; sources;)
+	{
+		const int source = MPTNextSource(sources);
+		m_AudioBuffers[source] = m_PipeAudioBuffers[source];
+	}
+	if(!slot) return;
+	for(uint32_t bus = 0; bus < m_BusCount; bus++)
+	{
+		if(MPT_ROUTING_UNROUTED != m_BusPrimary[bus])
+			m_AudioBuffers[m_BusPrimary[bus]] = m_AudioRing.channel(slot, (int)bus);
+	}
+}
+
+
+
+/**
+ * Negotiates the sample format and lets OpenMPT render into m_AudioBuffers.
+ * Rendering is done per source; from here on m_AudioBuffers and m_ServedChannelsBitfield are indexed by bus.
+**/
+void MPTRewirePanel::renderAudio(const MPTAudioRequest &request, MPTSharedRingSlot *slot)
+{
+	m_SampleFormat = (m_UseFloat32 && (request.capabilities & MPT_CAP_FLOAT32)) ? MPTSampleFormat::Float32 : MPTSampleFormat::Int32;
+	m_PackedFormat = 0;
 	ReWireClearBitField(m_ServedChannelsBitfield, kReWireAudioChannelCount / 2);
+	m_BlockRenderPosition = m_RenderPosition.load(std::memory_order_relaxed);
+	m_MixerTransport = request.transport;
+	const uint64_t renderStartNs = MPTNowNs();
 	m_RenderCallback(request.framesToRender, m_CallbackUserData);
+	if(m_GroupRenderCallback) renderChannelGroups(request.framesToRender);
+	m_RenderDoneNs = MPTNowNs();
+	m_Timing.render.record(m_RenderDoneNs - renderStartNs);
+	m_RenderPosition.store(m_BlockRenderPosition + request.framesToRender, std::memory_order_relaxed);
+	if(!m_IdentityRouting) mixSourcesIntoBuses(request.framesToRender, slot);
+	detectSilentChannels(request.framesToRender);
+}
+
 
-	// Inform the device that we are going to send audio packets
-	sendAudioResponseHeaderToDevice();
 
-	// Send response for each interleaved stereo channel
-	uint16_t audioDataSize = (uint16_t)(request.framesToRender * 2 * sizeof(int32_t));
-	uint16_t responseSize = (uint16_t)(sizeof(MPTAudioResponse) + audioDataSize);
-	for(uint16_t channel = 0; channel < kReWireAudioChannelCount / 2; channel++)
+/**
+ * Sums the rendered sources of every bus. A bus goes out from its channel in the shared audio ring slot,
+ * or else from the buffer of its first rendered source. Unrouted sources are left behind.
+**/
+void MPTRewirePanel::mixSourcesIntoBuses(uint32_t framesToRender, MPTSharedRingSlot *slot)
+{
+	const size_t sampleCount = (size_t)framesToRender * 2;
+	int *busBuffers[MPT_ROUTING_MAX_BUSES];
+	uint32_t servedBuses[4] = { 0 };
+	const uint64_t servedSources = ((uint64_t)m_ServedChannelsBitfield[1] << 32) | m_ServedChannelsBitfield[0];
+	for(uint64_t sources = servedSources & m_RoutedSources; sources;)
 	{
+		const int source = MPTNextSource(sources);
+		const uint8_t bus = m_Routing.sourceBus[source];
+		const int *sourceBuffer = m_AudioBuffers[source];
+		if(!ReWireIsBitInBitFieldSet(servedBuses, bus))
+		{
+			ReWireSetBitInBitField(servedBuses, bus);
+			busBuffers[bus] = slot ? m_AudioRing.channel(slot, bus) : m_AudioBuffers[source];
+			if(busBuffers[bus] != sourceBuffer) memcpy(busBuffers[bus], sourceBuffer, sampleCount * sizeof(int32_t));
+		} else if(MPTSampleFormat::Float32 == m_SampleFormat)
+		{
+			float *dest = reinterpret_cast<float *>(busBuffers[bus]);
+			const float *src = reinterpret_cast<const float *>(sourceBuffer);
+			for(size_t i = 0; i < sampleCount; i++) dest[i] += src[i];
+		} else
+		{
+			// Fixed point, mixed with the same headroom OpenMPT mixes its own channels with. That is used up by
+			// 16 sources at full scale, beyond that the bus clips rather than wraps around.
+			int *dest = busBuffers[bus];
+			for(size_t i = 0; i < sampleCount; i++)
+			{
+				const int64_t sum = (int64_t)dest[i] + sourceBuffer[i];
+				dest[i] = (int)((sum > INT32_MAX) ? INT32_MAX : (sum < INT32_MIN) ? INT32_MIN : sum);
+			}
+		}
+	}
 
-		// Only serve rendered channels
+	memcpy(m_ServedChannelsBitfield, servedBuses, sizeof(servedBuses));
+	for(uint32_t bus = 0; bus < m_BusCount; bus++)
+	{
+		if(ReWireIsBitInBitFieldSet(servedBuses, bus)) m_AudioBuffers[bus] = busBuffers[bus];
+	}
+}
+
+
+
+/**
+ * Hands the channel groups to the render pool and waits for all of them.
+ * Group callbacks report what they rendered through their return value rather than markChannelAsRendered(),
+ * which is not safe to call from several threads at once.
+**/
+void MPTRewirePanel::renderChannelGroups(uint32_t framesToRender)
+{
+	const int channelCount = kReWireAudioChannelCount / 2;
+	const uint32_t groupCount = (uint32_t)((channelCount + m_ChannelsPerGroup - 1) / m_ChannelsPerGroup);
+	m_GroupFramesToRender = framesToRender;
+	m_RenderPool.run(groupCount, &MPTRewirePanel::renderChannelGroup, this);
+
+	// Unrouted channels are rendered all the same, but there is nothing to send them with
+	uint64_t rendered = 0;
+	for(uint32_t group = 0; group < groupCount; group++)
+		rendered |= (uint64_t)m_GroupRendered[group] << (group * m_ChannelsPerGroup);
+	rendered &= m_RoutedSources;
+	m_ServedChannelsBitfield[0] |= (uint32_t)rendered;
+	m_ServedChannelsBitfield[1] |= (uint32_t)(rendered >> 32);
+}
+
+void MPTRewirePanel::renderChannelGroup(uint32_t group, void *context)
+{
+	MPTRewirePanel *panel = static_cast<MPTRewirePanel *>(context);
+	const int firstChannel = (int)group * panel->m_ChannelsPerGroup;
+	int channelCount = kReWireAudioChannelCount / 2 - firstChannel;
+	if(channelCount > panel->m_ChannelsPerGroup) channelCount = panel->m_ChannelsPerGroup;
+
+	const uint32_t rendered = panel->m_GroupRenderCallback(panel->m_GroupFramesToRender, firstChannel, channelCount, panel->m_CallbackUserData);
+	panel->m_GroupRendered[group] = rendered & (uint32_t)(((uint64_t)1 << channelCount) - 1);
+}
+
+
+
+/**
+ * Moves rendered channels that contain nothing but digital silence from the served to the silent bitfield,
+ * so that they are not transmitted at all.
+**/
+void MPTRewirePanel::detectSilentChannels(uint32_t framesToRender)
+{
+	const MPTAudioKernels &kernels = MPTGetAudioKernels();
+	ReWireClearBitField(m_SilentChannelsBitfield, kReWireAudioChannelCount / 2);
+	for(uint16_t channel = 0; channel < m_BusCount; channel++)
+	{
+		if(!ReWireIsBitInBitFieldSet(m_ServedChannelsBitfield, channel))
+			continue;
+		if(kernels.isSilent(reinterpret_cast<const uint32_t *>(m_AudioBuffers[channel]), (size_t)framesToRender * 2))
+		{
+			m_ServedChannelsBitfield[channel >> 5] &= ~(1u << (channel & 0x1f));
+			ReWireSetBitInBitField(m_SilentChannelsBitfield, channel);
+		}
+	}
+}
+
+
+
+/**
+ * Only the first source of a bus renders into the slot; the others and the unrouted ones still render into the
+ * pipe buffers, so the block has to fit into those as well.
+**/
+bool MPTRewirePanel::generateAudioIntoSharedMemory(const MPTAudioRequest &request)
+{
+	if(!isUsingSharedMemoryTransport()
+		|| request.framesToRender > m_AudioRing.maxFrames()
+		|| request.framesToRender > (uint32_t)m_Buffers->capacity
+		|| m_AudioRing.channelCount() < m_BusCount)
+		return false;
+
+	MPTSharedRingSlot *slot = m_AudioRing.acquireWriteSlot();
+	if(!slot) return false;  // device is lagging behind, use the COM pipe for this block
+
+	// Let OpenMPT render the audio channels directly into the slot
+	prepareSourceBuffers(slot);
+	renderAudio(request, slot);
+
+	// The slot carries its own header, so the device only needs a wakeup and no acknowledgement
+	slot->sequence = request.sequence;
+	slot->framesToRender = request.framesToRender;
+	fillAudioResponseHeader(slot->responseHeader, MPT_CAP_SHARED_MEMORY | formatFlags());
+	m_AudioRing.publishWriteSlot();
+	m_SignalToDevice.set();
+	return true;
+}
+
+
+
+/**
+ * Packs the header and every served channel into one message, so the device only needs to be woken once.
+ * Returns false if the block is too large for a single message, or the pipe did not take it, and has to be sent
+ * per channel instead.
+**/
+bool MPTRewirePanel::sendAudioBatchToDevice(const MPTAudioRequest &request)
+{
+	size_t audioDataSize = (size_t)request.framesToRender * MPTPayloadFrameSize(m_PackedFormat);
+	size_t batchSize = sizeof(MPTAudioResponseHeader);
+	for(uint16_t channel = 0; channel < m_BusCount; channel++)
+	{
+		if(ReWireIsBitInBitFieldSet(m_ServedChannelsBitfield, channel))
+			batchSize += audioDataSize;
+	}
+	if(batchSize > MPT_MAX_BATCH_SIZE) return false;
+
+	fillAudioResponseHeader(*reinterpret_cast<MPTAudioResponseHeader *>(m_BatchBuffer), MPT_CAP_BATCHED | formatFlags());
+
+	// RWPComSend only takes a single buffer, so the served channels still have to be gathered; packing does that on the way
+	uint8_t *pDest = m_BatchBuffer + sizeof(MPTAudioResponseHeader);
+	for(uint16_t channel = 0; channel < m_BusCount; channel++)
+	{
 		if(!ReWireIsBitInBitFieldSet(m_ServedChannelsBitfield, channel))
 			continue;
+		if(m_PackedFormat)
+			packAudioChannel(channel, request.framesToRender, pDest);
+		else
+			memcpy(pDest, m_AudioBuffers[channel], audioDataSize);
+		pDest += audioDataSize;
+	}
+
+	ReWireError status = RWPComSend(m_PanelPortHandle, PIPE_RT, (uint16_t)batchSize, m_BatchBuffer);
+	if(kReWireError_NoError != status)
+	{
+		DEBUG_PRINT("sendAudioBatchToDevice(): RWPComSend status=%i\n", (int)status);
+		return false;
+	}
+
+	m_SignalToDevice.set();
+	return true;
+}
+
+
+
+/**
+ * Sends a channel straight from where it was rendered, in as many chunks as the 16-bit message size requires.
+ * Every message but the very last one of the block is acknowledged by the device, see generateAudioAndUploadToDevice().
+**/
+bool MPTRewirePanel::sendAudioChannelToDevice(uint16_t channel, size_t audioDataSize, bool lastChannel, bool offline)
+{
+	// Packed in place, right behind the MPTAudioResponse
+	uint8_t *pAudio = reinterpret_cast<uint8_t *>(m_AudioBuffers[channel]);
+	pipeAudioResponse(channel)->channelIndex = channel;
+	if(m_PackedFormat) packAudioChannel(channel, (uint32_t)(audioDataSize / MPTPayloadFrameSize(m_PackedFormat)), pAudio);
+
+	const size_t maxChunkSize = MPTMaxChunkSize(MPTPayloadFrameSize(m_PackedFormat));
+	for(size_t offset = 0; offset < audioDataSize;)
+	{
+		size_t chunkSize = audioDataSize - offset;
+		if(chunkSize > maxChunkSize) chunkSize = maxChunkSize;
 
-		// Send channel to device
-		m_AudioResponseBuffer->channelIndex = channel;
-		uint8_t *pDest = reinterpret_cast<uint8_t *>(m_AudioResponseBuffer) + sizeof(MPTAudioResponse);
-		memcpy(pDest, reinterpret_cast<void *>(m_AudioBuffers[channel]), audioDataSize);
+		// Only the first chunk takes the MPTAudioResponse along
+		uint8_t *pMessage = pAudio + offset;
+		uint16_t messageSize = (uint16_t)chunkSize;
+		if(!offset)
+		{
+			pMessage = reinterpret_cast<uint8_t *>(pipeAudioResponse(channel));
+			messageSize += sizeof(MPTAudioResponse);
+		}
+		offset += chunkSize;
 
-		ReWireError status = RWPComSend(m_PanelPortHandle, PIPE_RT, responseSize, (uint8_t *)m_AudioResponseBuffer);
+		if(m_Credits && !waitForCredit()) return false;
+		// Neither a bounce nor a block with credits waits for the device between two messages, so the pipe may be full
+		ReWireError status = RWPComSend(m_PanelPortHandle, PIPE_RT, messageSize, pMessage);
+		for(const uint64_t deadlineNs = MPTNowNs() + SEND_RETRY_TIMEOUT_MS * 1000000ull;
+			(offline || m_Credits) && kReWireError_BufferFull == status && m_Running && MPTNowNs() < deadlineNs;)
+		{
+			std::this_thread::yield();  // the device is busy emptying the pipe
+			status = RWPComSend(m_PanelPortHandle, PIPE_RT, messageSize, pMessage);
+		}
 		if(kReWireError_NoError != status)
 		{
 			DEBUG_PRINT("RWPComSend status=%i channel=%i\n", (int)status, (int)channel);
-			break;
+			return false;
 		}
 
-		// Signal to device that we have just sent a channel
-		SetEvent(m_EventToDevice);
+		// Signal to device that we have just sent a channel, or a chunk of one
+		m_SignalToDevice.set();
+		m_MessagesSent++;
 
 		// ... (Device is going to process our channel) ...
 
+		// The last message is not acknowledged. The acknowledgement would share the auto-reset event with the
+		// device's next request, and if both were set before we woke up, we would only see one of them.
+		// During a bounce none of them is.
+		if(lastChannel && offset == audioDataSize) break;
+		if(offline || m_Credits) continue;
+
 		// Wait for device to signal that it received our channel
-		if(!waitForEventFromDevice()) break;
+		if(!waitForEventFromDevice())
+		{
+			MPTIncrementCounter(m_Timing.timeouts);
+			return false;
+		}
 	}
+	return true;
 }
 
 
 
-bool MPTRewirePanel::sendAudioResponseHeaderToDevice()
+// Waits until the device has consumed enough messages for us to send another one
+bool MPTRewirePanel::waitForCredit()
+{
+	const std::atomic<uint32_t> &consumed = m_Control.header()->consumedMessages;
+	while(m_MessagesSent - consumed.load(std::memory_order_acquire) >= m_Credits)
+	{
+		if(!waitForEventFromDevice())
+		{
+			MPTIncrementCounter(m_Timing.timeouts);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+void MPTRewirePanel::packAudioChannel(int channel, uint32_t framesToRender, uint8_t *dest)
+{
+	const MPTAudioKernels &kernels = MPTGetAudioKernels();
+	if(MPT_CAP_PACKED16 == m_PackedFormat)
+		kernels.packInt16(m_AudioBuffers[channel], dest, (size_t)framesToRender * 2, m_DitherState);
+	else
+		kernels.packInt24(m_AudioBuffers[channel], dest, (size_t)framesToRender * 2);
+}
+
+
+
+void MPTRewirePanel::fillAudioResponseHeader(MPTAudioResponseHeader &header, uint32_t flags) const
+{
+	memcpy(header.servedChannelsBitfield, m_ServedChannelsBitfield, sizeof(MPTAudioResponseHeader::servedChannelsBitfield));
+	memcpy(header.silentChannelsBitfield, m_SilentChannelsBitfield, sizeof(MPTAudioResponseHeader::silentChannelsBitfield));
+	header.flags = flags;
+	header.renderPosition = m_BlockRenderPosition;
+}
+
+
+
+bool MPTRewirePanel::sendAudioResponseHeaderToDevice(uint32_t flags, bool waitForDevice)
 {
 	MPTAudioResponseHeader packet;
-	memcpy((uint8_t *)&packet.servedChannelsBitfield, m_ServedChannelsBitfield, sizeof(MPTAudioResponseHeader::servedChannelsBitfield));
+	fillAudioResponseHeader(packet, flags);
 
 	ReWireError status = RWPComSend(m_PanelPortHandle, PIPE_RT, sizeof(packet), (uint8_t *)&packet);
 	if(kReWireError_NoError != status)
@@ -371,8 +1019,115 @@ bool MPTRewirePanel::sendAudioResponseHeaderToDevice()
 		return false;
 	}
 
-	SetEvent(m_EventToDevice);
-	return waitForEventFromDevice();
+	m_SignalToDevice.set();
+	if(!waitForDevice || waitForEventFromDevice()) return true;
+	MPTIncrementCounter(m_Timing.timeouts);
+	return false;
+}
+
+
+
+void MPTRewirePanel::recordBlockTiming(uint64_t startNs)
+{
+	const uint64_t endNs = MPTNowNs();
+	MPTIncrementCounter(m_Timing.blocks);
+	m_Timing.total.record(endNs - startNs);
+	// Blocks that were dropped rather than rendered have no upload to speak of
+	if(m_RenderDoneNs >= startNs) m_Timing.upload.record(endNs - m_RenderDoneNs);
+}
+
+
+
+bool MPTRewirePanel::getDeviceZeroingStats(MPTDeviceZeroingStats &stats) const
+{
+	const MPTSharedControlHeader *header = m_Control.header();
+	if(!header) return false;
+	stats.channelsZeroed = header->channelsZeroed.load(std::memory_order_relaxed);
+	stats.channelsZeroingAvoided = header->channelsZeroingAvoided.load(std::memory_order_relaxed);
+	stats.bytesZeroingAvoided = header->bytesZeroingAvoided.load(std::memory_order_relaxed);
+	return true;
+}
+
+bool MPTRewirePanel::getDeviceLockedMemoryStats(MPTLockedMemoryStats &stats) const
+{
+	const MPTSharedControlHeader *header = m_Control.header();
+	if(!header) return false;
+	stats.lockedBytes = header->lockedMemoryBytes.load(std::memory_order_relaxed);
+	stats.unlockedBytes = header->unlockedMemoryBytes.load(std::memory_order_relaxed);
+	stats.hugePageBytes = header->hugePageBytes.load(std::memory_order_relaxed);
+	return true;
+}
+
+bool MPTRewirePanel::getDeviceTimingStats(MPTDeviceTimingStats &stats) const
+{
+	const MPTSharedControlHeader *header = m_Control.header();
+	if(!header) return false;
+	MPTSummarizeDeviceTiming(header->deviceTiming, stats);
+	return true;
+}
+
+
+
+void MPTRewirePanel::setRenderAhead(uint32_t blocks)
+{
+	m_RenderAhead = (blocks > MPT_MAX_RENDER_AHEAD) ? MPT_MAX_RENDER_AHEAD : blocks;
+	if(m_Control.isOpen())
+	{
+		m_Control.header()->requestedRenderAhead.store(m_UseSharedMemory ? m_RenderAhead : 0, std::memory_order_relaxed);
+		m_Control.header()->offlineRenderAhead.store(m_UseSharedMemory ? MPT_OFFLINE_RENDER_AHEAD : 0, std::memory_order_relaxed);
+	}
+}
+
+uint32_t MPTRewirePanel::getRenderAheadLatency() const
+{
+	const MPTSharedControlHeader *header = m_Control.header();
+	return header ? header->renderAheadLatencyFrames.load(std::memory_order_relaxed) : 0;
+}
+
+void MPTRewirePanel::setRenderQuantum(uint32_t frames)
+{
+	m_RenderQuantum = (frames > MPT_MAX_RENDER_QUANTUM) ? MPT_MAX_RENDER_QUANTUM : frames;
+	if(m_Control.isOpen()) m_Control.header()->requestedRenderQuantum.store(m_RenderQuantum, std::memory_order_relaxed);
+}
+
+uint32_t MPTRewirePanel::getRenderQuantumLatency() const
+{
+	const MPTSharedControlHeader *header = m_Control.header();
+	return header ? header->renderQuantumLatencyFrames.load(std::memory_order_relaxed) : 0;
+}
+
+
+
+/**
+ * Routing: which sources are summed into which bus, see MPTRewireRouting.h
+**/
+void MPTRewirePanel::useRouting(const MPTRoutingMap &routing)
+{
+	m_Routing = routing;
+	if(m_Routing.busCount > MPT_ROUTING_MAX_BUSES) m_Routing.busCount = MPT_ROUTING_MAX_BUSES;
+	m_BusCount = m_Routing.busCount;
+	m_RoutedSources = MPTRoutedSources(m_Routing);
+	m_IdentityRouting = MPTIsIdentityRouting(m_Routing);
+	memset(m_BusPrimary, MPT_ROUTING_UNROUTED, sizeof(m_BusPrimary));
+	for(int source = MPT_ROUTING_SOURCES - 1; source >= 0; source--)
+	{
+		if(m_RoutedSources & ((uint64_t)1 << source)) m_BusPrimary[m_Routing.sourceBus[source]] = (uint8_t)source;
+	}
+}
+
+void MPTRewirePanel::routingMapPath(char *path, size_t pathSize)
+{
+	// The device is registered from our own directory, see the constructor
+	char moduleFileName[MAX_PATH] = { 0 };
+	GetModuleFileNameA(NULL, moduleFileName, MAX_PATH);
+	MPTRoutingMapPath(moduleFileName, path, pathSize);
+}
+
+bool MPTRewirePanel::saveRoutingMap(const MPTRoutingMap &routing)
+{
+	char path[MAX_PATH + sizeof(MPT_ROUTING_MAP_FILE)];
+	routingMapPath(path, sizeof(path));
+	return MPTSaveRoutingMap(path, routing);
 }
 
 
@@ -380,7 +1135,8 @@ bool MPTRewirePanel::sendAudioResponseHeaderToDevice()
 void MPTRewirePanel::handleAudioInfoChange(int sampleRate, int maxBufferSize)
 {
 	DEBUG_PRINT("Samplerate = %i, MaxBufferSize = %i\n", sampleRate, maxBufferSize);
-	reallocateBuffers(maxBufferSize);
+	m_MaxBufferSize = maxBufferSize;
+	if(m_Buffers && maxBufferSize != m_Buffers->capacity) requestBufferCapacity(maxBufferSize);
 
 	// If this function was called because we received our first audio request,
 	// then we do not need to notify the ReWire sound device.
@@ -400,20 +1156,23 @@ void MPTRewirePanel::handleAudioInfoChange(int sampleRate, int maxBufferSize)
  * 
  ******************************************************************************/
 
-void MPTRewirePanel::signalPlay(double bpm) {
+void MPTRewirePanel::signalPlay(double bpm, uint32_t frameOffset) {
 	MPTPlayRequest req;
 	req.type = (uint8_t)MPTPanelEvent::Play;
+	req.framePosition = m_RenderPosition.load(std::memory_order_relaxed) + frameOffset;
 	req.tempo = static_cast<uint32_t>(bpm * 1000);
 	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(req), reinterpret_cast<uint8_t *>(&req));
 }
 
-void MPTRewirePanel::signalStop() {
-	uint8_t message[1];
-	message[0] = (uint8_t)MPTPanelEvent::Stop;
-	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(message), message);
+void MPTRewirePanel::signalStop(uint32_t frameOffset) {
+	MPTEventRequest req;
+	req.type = (uint8_t)MPTPanelEvent::Stop;
+	req.framePosition = m_RenderPosition.load(std::memory_order_relaxed) + frameOffset;
+	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(req), reinterpret_cast<uint8_t *>(&req));
 }
 
-void MPTRewirePanel::signalReposition(double bpm, int nFrames) {
+// Only an estimate of the mixer's position, prefer signalRepositionToPPQ() with getMixerTransport()
+void MPTRewirePanel::signalReposition(double bpm, int nFrames, uint32_t frameOffset) {
 
 	/*DEBUG_PRINT("Reposition, frames:%i\n",
 		nFrames
@@ -421,6 +1180,7 @@ void MPTRewirePanel::signalReposition(double bpm, int nFrames) {
 
 	MPTRepositionRequest req;
 	req.type = (uint8_t)MPTPanelEvent::Reposition;
+	req.framePosition = m_RenderPosition.load(std::memory_order_relaxed) + frameOffset;
 	double seconds = (double)nFrames / m_SampleRate;
 	double bps = bpm / 60.0;
 	double beatsPassed = seconds * bps;
@@ -439,9 +1199,18 @@ void MPTRewirePanel::signalReposition(double bpm, int nFrames) {
 	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(req), reinterpret_cast<uint8_t*>(&req));
 }
 
-void MPTRewirePanel::signalBPMChange(double bpm) {
-	uint8_t message[5];
-	message[0] = (uint8_t)MPTPanelEvent::ChangeBPM;
-	*(uint32_t *)&message[1] = static_cast<uint32_t>(bpm * 1000);
-	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(message), message);
+void MPTRewirePanel::signalRepositionToPPQ(int32_t position15360PPQ, uint32_t frameOffset) {
+	MPTRepositionRequest req;
+	req.type = (uint8_t)MPTPanelEvent::Reposition;
+	req.framePosition = m_RenderPosition.load(std::memory_order_relaxed) + frameOffset;
+	req.position15360PPQ = (uint32_t)position15360PPQ;
+	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(req), reinterpret_cast<uint8_t *>(&req));
+}
+
+void MPTRewirePanel::signalBPMChange(double bpm, uint32_t frameOffset) {
+	MPTTempoRequest req;
+	req.type = (uint8_t)MPTPanelEvent::ChangeBPM;
+	req.framePosition = m_RenderPosition.load(std::memory_order_relaxed) + frameOffset;
+	req.tempo = static_cast<uint32_t>(bpm * 1000);
+	RWPComSend(m_PanelPortHandle, PIPE_EVENTS, sizeof(req), reinterpret_cast<uint8_t *>(&req));
 }
\ No newline at end of file
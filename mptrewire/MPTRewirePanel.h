@@ -1,13 +1,41 @@
 #pragma once
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <string>
 #include <stdint.h>
+#include "ReWire.h"
+#include "MPTRewireAudioKernels.h"
+#include "MPTRewireMemory.h"
+#include "MPTRewireProtocol.h"
+#include "MPTRewireRouting.h"
+#include "MPTRewireSharedMemory.h"
+#include "MPTRewireRenderPool.h"
+#include "MPTRewireStats.h"
+#include "MPTRewireThread.h"
+#include "MPTRewireWait.h"
 
-#define PIPE_EVENTS 0
-#define PIPE_RT     1  // realtime audio thread
+#define MPT_PANEL_MESSAGE_SIZE 8192      // largest message the device sends us on PIPE_RT
+#define MPT_PANEL_INITIAL_CAPACITY 1024  // frames per channel until the mixer tells us its buffer size
 
 
+// Sample format of m_AudioBuffers for the block that is currently being rendered
+enum class MPTSampleFormat
+{
+	Int32 = 0,    // fixed point, scaled by MIXING_SCALEF
+	Float32 = 1,  // negotiated through MPT_CAP_FLOAT32
+};
+
+// What the channels are converted to before they go through the pipe. The shared-memory transport is not affected.
+enum class MPTPayloadFormat
+{
+	Native = 0,    // as rendered, see MPTSampleFormat
+	Packed24 = 1,  // MPT_CAP_PACKED24, 6 instead of 8 bytes per frame
+	Packed16 = 2,  // MPT_CAP_PACKED16, 4 bytes per frame
+};
+
 enum class MPTPanelStatus
 {
 	Ok = 0,
@@ -19,55 +47,29 @@ enum class MPTPanelStatus
 	FirstTime = 6,
 };
 
-// These get sent to the device as commands to the mixer
-enum class MPTPanelEvent
-{
-	Play = 0,
-	Stop = 1,
-	ChangeBPM = 2,
-	Reposition = 3
-};
-
 typedef struct
 {
-	uint8_t type;
-	uint32_t tempo;
-} MPTPlayRequest;
+	uint64_t channelsZeroed;          // unserved stereo channels whose mixer buffers the device had to zero
+	uint64_t channelsZeroingAvoided;  // unserved stereo channels that were verified to be zero still
+	uint64_t bytesZeroingAvoided;
+} MPTDeviceZeroingStats;
 
-typedef struct
+// One generation of pipe channels, sized to the mixer's maximum buffer size and holding the routed sources only;
+// the unrouted ones share a single discard buffer. Every buffer is there before the first block is rendered.
+// The audio thread only ever swaps in a whole set that was allocated elsewhere.
+typedef struct MPTPanelBuffers
 {
-	uint8_t type;
-	uint32_t position15360PPQ;
-	//LARGE_INTEGER timeIssued; //uint64_t timeIssued;
-	//double bpm;
-} MPTRepositionRequest;
-
-typedef struct
-{
-	int32_t sampleRate;
-	int32_t maxBufferSize;
-	uint32_t framesToRender;
-} MPTAudioRequest;
-
-typedef struct
-{
-	int32_t sampleRate;
-	int32_t maxBufferSize;
-} MPTAudioInfoRequest;
-
-typedef struct
-{
-	uint32_t servedChannelsBitfield[4];  // 128 bits, one stereo channel for each bit
-} MPTAudioResponseHeader;                // sent once before a bunch of MPTAudioResponse packets are sent
-
-typedef struct
-{
-	uint16_t channelIndex;  // @TODO: optimize this away for performance reasons, then this struct becomes:
-							//        typedef int32_t* MPTAudioResponse;
-	// <interleaved audio channel (2 * fFramesToRender * sizeof(int))>
-} MPTAudioResponse;
+	MPTLockedBuffer arena;         // all channels in one locked, page-aligned block, see allocateBuffers()
+	int32_t capacity;              // frames per channel
+	int *pipeAudioBuffers[kReWireAudioChannelCount / 2];  // one per stereo channel (routing source)
+	int *audioBuffers[kReWireAudioChannelCount / 2];      // what m_AudioBuffers points to
+	MPTPanelBuffers *nextRetired;
+} MPTPanelBuffers;
 
 typedef bool (*MPTRenderCallback)(unsigned int framesToRender, void *userData);
+// Renders the stereo channels firstChannel .. firstChannel + channelCount - 1, possibly on a worker thread.
+// Returns a bit for every channel it rendered, bit 0 being firstChannel.
+typedef uint32_t (*MPTChannelGroupRenderCallback)(unsigned int framesToRender, int firstChannel, int channelCount, void *userData);
 typedef void (*MPTAudioInfoCallback)(unsigned int sampleRate, unsigned int maxBufferSize, void *userData);
 typedef void (*MPTMixerQuitCallback)(void *userData);
 typedef void *TRWPPortHandle;
@@ -78,19 +80,65 @@ class MPTRewirePanel
 {
 private:
 	std::thread m_Thread;
+	MPTThreadOptions m_ThreadOptions;
+	std::atomic<MPTSchedulingClass> m_SchedulingClass{MPTSchedulingClass::Normal};  // what the audio thread got
+	std::atomic<bool> m_ThreadPinned{false};
 	bool m_Running = false;
 	bool m_MixerQuit = false;
 	const char *m_DeviceName = "OpenMPT";
 
 	void *m_CallbackUserData = nullptr;
 	MPTRenderCallback m_RenderCallback = nullptr;
+	MPTChannelGroupRenderCallback m_GroupRenderCallback = nullptr;
+	MPTRenderPool m_RenderPool;
+	int m_RenderWorkers = 0;
+	int m_ChannelsPerGroup = 4;
+	uint64_t m_WorkerAffinityMask = 0;
+	uint32_t m_GroupFramesToRender = 0;
+	uint32_t m_GroupRendered[MPT_RENDER_POOL_MAX_TASKS];  // return values of the group callbacks
 	MPTAudioInfoCallback m_AudioInfoCallback = nullptr;
 	MPTMixerQuitCallback m_MixerQuitCallback = nullptr;
 
-	MPTAudioResponse *m_AudioResponseBuffer = nullptr;
+	MPTPanelBuffers *m_Buffers = nullptr;  // owned by the audio thread once it runs
+	std::atomic<MPTPanelBuffers *> m_PendingBuffers{nullptr};  // allocated for the audio thread, adopted before its next block
+	std::atomic<MPTPanelBuffers *> m_RetiredBuffers{nullptr};  // dropped by the audio thread, freed by the allocator
+	std::atomic<int32_t> m_RequestedCapacity{0};
+	int32_t m_AllocatedCapacity = 0;               // of the newest set, only touched by whoever allocates it
+	uint64_t m_AllocatedRouting = 0;               // sources that are routed anywhere, the rest share a discard buffer
+	std::thread m_AllocatorThread;
+	std::mutex m_AllocatorMutex;
+	std::condition_variable m_AllocatorWakeup;
+	bool m_AllocatorQuit = false;
+	MPTLockedBuffer m_ControlMemory;   // m_Message and m_BatchBuffer
+	uint8_t *m_BatchBuffer = nullptr;  // header followed by all served channels
+	int **m_PipeAudioBuffers = nullptr;  // channels of m_Buffers, m_AudioBuffers points here unless rendering into the ring
+	MPTSharedControl m_Control;                     // the device's settings, statistics, signals and credits
+	MPTSharedAudioRing m_AudioRing;                 // mapped by the allocator once the device created it, see mapAudioRing()
+	std::atomic<bool> m_AudioRingReady{false};      // m_AudioRing may be used on the audio thread
+	bool m_AudioRingFailed = false;                 // could not be mapped, the allocator does not try again
+	MPTRoutingMap m_Routing;
+	uint32_t m_BusCount = MPT_ROUTING_SOURCES;  // stereo channels that go to the device
+	uint64_t m_RoutedSources = ~(uint64_t)0;
+	bool m_IdentityRouting = true;              // nothing to sum, sources go out as they are
+	uint8_t m_BusPrimary[MPT_ROUTING_MAX_BUSES];  // lowest source of every bus, renders straight into the shared audio ring
+	bool m_UseSharedMemory = false;
+	bool m_UseFloat32 = false;
+	MPTPayloadFormat m_PayloadFormat = MPTPayloadFormat::Native;
+	uint32_t m_PackedFormat = 0;  // MPT_CAP_PACKED* used for the channels of the current block, 0 if none
+	uint32_t m_DitherState[MPT_DITHER_LANES];
+	uint32_t m_RenderAhead = 0;
+	uint32_t m_Credits = 0;        // messages we may have in flight on the per-channel path, 0 = stop-and-wait
+	uint32_t m_MessagesSent = 0;   // of the current block, compared against what the device consumed
+	uint32_t m_RenderQuantum = 0;
 	TRWPPortHandle m_PanelPortHandle = nullptr;
-	uint8_t m_Message[8192];
+	uint8_t *m_Message = nullptr;  // MPT_PANEL_MESSAGE_SIZE bytes
 	uint32_t m_ServedChannelsBitfield[4];  // 128 bits
+	uint32_t m_SilentChannelsBitfield[4];
+	std::atomic<uint32_t> m_RenderPosition{0};  // start of the block being rendered, or of the next one in between
+	uint32_t m_BlockRenderPosition = 0;         // start of the block last rendered
+	MPTTransportState m_MixerTransport = {};    // of the block last rendered
+	MPTPanelTiming m_Timing;
+	uint64_t m_RenderDoneNs = 0;
 
 	// Signals to device whenever an audio buffer was sent by us.
 	HANDLE m_EventToDevice;
@@ -98,16 +146,52 @@ private:
 	// Lets us know when an audio buffer sent by us was received and processed by the device.
 	HANDLE m_EventFromDevice;
 
+	// Spin-then-block wrappers around the two events above
+	MPTHybridEvent m_SignalToDevice;
+	MPTHybridEvent m_SignalFromDevice;
+	bool m_SpinWait = true;
+	bool m_OfflineDetection = true;
+
 
+	static MPTPanelBuffers *allocateBuffers(int32_t capacity, uint64_t routedSources);
+	static void freeBuffers(MPTPanelBuffers *buffers);
 	void deallocateBuffers();
-	void reallocateBuffers(int32_t maxBufferSize);
+	void useBuffers(MPTPanelBuffers *buffers);
+	void adoptPendingBuffers();
+	void retireBuffers(MPTPanelBuffers *buffers);
+	void requestBufferCapacity(int32_t capacity);
+	void startAllocator();
+	void stopAllocator();
+	void allocatorProc();
+	void mapAudioRing();
+	void useRouting(const MPTRoutingMap &routing);
+	static void routingMapPath(char *path, size_t pathSize);
 	void checkComConnection();
 	void handleAudioInfoChange(int sampleRate, int maxBufferSize);
 	void pollAudioRequests();
+	bool readAudioRequest(MPTAudioRequest &request);
 	bool waitForEventFromDevice(const int milliseconds = 100);
+	void useSharedSignals();
 	void swallowRemainingMessages();
 	void generateAudioAndUploadToDevice(MPTAudioRequest incomingRequest);
-	bool sendAudioResponseHeaderToDevice();
+	void prepareSourceBuffers(MPTSharedRingSlot *slot);
+	void renderAudio(const MPTAudioRequest &request, MPTSharedRingSlot *slot);
+	void mixSourcesIntoBuses(uint32_t framesToRender, MPTSharedRingSlot *slot);
+	void renderChannelGroups(uint32_t framesToRender);
+	static void renderChannelGroup(uint32_t group, void *context);
+	void detectSilentChannels(uint32_t framesToRender);
+	bool generateAudioIntoSharedMemory(const MPTAudioRequest &request);
+	bool sendAudioBatchToDevice(const MPTAudioRequest &request);
+	bool sendAudioResponseHeaderToDevice(uint32_t flags = 0, bool waitForDevice = true);
+	bool sendAudioChannelToDevice(uint16_t channel, size_t audioDataSize, bool lastChannel, bool offline);
+	bool waitForCredit();
+	void packAudioChannel(int channel, uint32_t framesToRender, uint8_t *dest);
+	void fillAudioResponseHeader(MPTAudioResponseHeader &header, uint32_t flags) const;
+	void recordBlockTiming(uint64_t startNs);
+	inline MPTAudioResponse *pipeAudioResponse(int channel) const {
+		return reinterpret_cast<MPTAudioResponse *>(reinterpret_cast<uint8_t *>(m_AudioBuffers[channel]) - sizeof(MPTAudioResponse));
+	}
+	uint32_t formatFlags() const { return ((MPTSampleFormat::Float32 == m_SampleFormat) ? MPT_CAP_FLOAT32 : 0) | m_PackedFormat; }
 
 
 
@@ -116,6 +200,7 @@ public:
 	int m_SampleRate = 0;
 	int m_MaxBufferSize = 0;
 	int **m_AudioBuffers = nullptr;
+	MPTSampleFormat m_SampleFormat = MPTSampleFormat::Int32;
 
 
 
@@ -131,14 +216,72 @@ public:
 	void threadProc();
 	bool isRunning() { return m_Running; }
 	void stop() { m_Running = false; }
+	// Opt into the shared-memory transport, takes effect on the next open()
+	void useSharedMemoryTransport(bool enable) { m_UseSharedMemory = enable; }
+	bool isUsingSharedMemoryTransport() const { return m_UseSharedMemory && m_AudioRingReady.load(std::memory_order_acquire); }
+	bool getDeviceZeroingStats(MPTDeviceZeroingStats &stats) const;
+	// Which stereo channels go to which ReWire channel, see MPTRewireRouting.h. The device picks the map up when the
+	// mixer loads it, so a saved map takes effect from the next mixer session on. Unrouted channels need not be rendered.
+	static bool saveRoutingMap(const MPTRoutingMap &routing);
+	const MPTRoutingMap &getRoutingMap() const { return m_Routing; }
+	bool isChannelRouted(int stereoChannel) const { return 0 != (m_RoutedSources & ((uint64_t)1 << stereoChannel)); }
+	// Latency histograms and failure counters of both sides, cheap enough to poll from the GUI
+	void getPanelTimingStats(MPTPanelTimingStats &stats) const { MPTSummarizePanelTiming(m_Timing, stats); }
+	bool getDeviceTimingStats(MPTDeviceTimingStats &stats) const;
+	// How much of the audio path is locked into RAM, see MPTRewireMemory.h. The panel's figures cover its whole process.
+	void getLockedMemoryStats(MPTLockedMemoryStats &stats) const { MPTGetLockedMemoryStats(stats); }
+	bool getDeviceLockedMemoryStats(MPTLockedMemoryStats &stats) const;
+	// Render up to MPT_MAX_RENDER_AHEAD blocks ahead of the mixer. Needs the shared-memory transport.
+	void setRenderAhead(uint32_t blocks);
+	uint32_t getRenderAheadLatency() const;  // in frames, as currently applied by the device
+	// Render at least this many frames (up to MPT_MAX_RENDER_QUANTUM) per block when the mixer asks for fewer,
+	// the device serves the callbacks in between on its own. 0 renders exactly what the mixer asks for.
+	void setRenderQuantum(uint32_t frames);
+	uint32_t getRenderQuantumLatency() const;  // in frames, as currently applied by the device
+	// The mixer's transport where the block being rendered starts, for the render callback to follow the host
+	const MPTTransportState &getMixerTransport() const { return m_MixerTransport; }
+	// Run the audio thread at real-time priority, optionally pinned to the CPUs in affinityMask (0: any).
+	// Takes effect on the next open(); without the privileges for it the thread stays at normal priority.
+	void useRealTimeScheduling(bool enable, uint64_t affinityMask = 0, bool roundRobin = false) {
+		m_ThreadOptions.realTime = enable;
+		m_ThreadOptions.affinityMask = affinityMask;
+		m_ThreadOptions.roundRobin = roundRobin;
+	}
+	MPTSchedulingClass getAudioThreadSchedulingClass() const { return m_SchedulingClass.load(std::memory_order_relaxed); }
+	bool isAudioThreadPinned() const { return m_ThreadPinned.load(std::memory_order_relaxed); }
+	// Render channel groups in parallel: after the render callback has run for a block, groupCallback is called for
+	// every group of channelsPerGroup (1-32) stereo channels, spread across the audio thread and workerCount workers.
+	// The render callback still runs first and alone, e.g. to advance the song. Takes effect on the next open().
+	// Workers get the audio thread's priority, but not its affinity: they are pinned to workerAffinityMask (0: any).
+	void useParallelRendering(MPTChannelGroupRenderCallback groupCallback, int workerCount, int channelsPerGroup = 4, uint64_t workerAffinityMask = 0) {
+		m_GroupRenderCallback = groupCallback;
+		m_RenderWorkers = workerCount;
+		m_WorkerAffinityMask = workerAffinityMask;
+		m_ChannelsPerGroup = (channelsPerGroup < 1) ? 1 : (channelsPerGroup > 32) ? 32 : channelsPerGroup;
+	}
+	int getRenderWorkerCount() const { return m_RenderPool.workerCount(); }
+	// Spin briefly before sleeping whenever one side waits for the other, takes effect on the next open()
+	void useSpinWait(bool enable) { m_SpinWait = enable; }
+	// Let the device switch to throughput mode when the mixer bounces, takes effect on the next open()
+	void useOfflineDetection(bool enable) { m_OfflineDetection = enable; }
+	// Offer float mix buffers; the render callback must then honour m_SampleFormat
+	void useFloat32Format(bool enable) { m_UseFloat32 = enable; }
+	// Trade precision for pipe bandwidth. Packing starts from int32, so it takes precedence over float32 on the pipe.
+	void usePayloadFormat(MPTPayloadFormat format) { m_PayloadFormat = format; }
+	inline float *getFloatAudioBuffer(int index) {
+		return reinterpret_cast<float *>(m_AudioBuffers[index]);
+	}
 	inline void markChannelAsRendered(int index) {
 		m_ServedChannelsBitfield[index >> 5] |= 1 << (index & 0x1f);
 	}
 
-	void signalPlay(double bpm);
-	void signalStop();
-	void signalBPMChange(double bpm);
-	void signalReposition(double bpm, int nFrames);
+	// frameOffset is relative to the start of the block being rendered, so calls from the render callback
+	// can be placed on the exact sample. The device delays or compensates the event accordingly.
+	void signalPlay(double bpm, uint32_t frameOffset = 0);
+	void signalStop(uint32_t frameOffset = 0);
+	void signalBPMChange(double bpm, uint32_t frameOffset = 0);
+	void signalReposition(double bpm, int nFrames, uint32_t frameOffset = 0);
+	void signalRepositionToPPQ(int32_t position15360PPQ, uint32_t frameOffset = 0);  // exact, e.g. relative to getMixerTransport()
 	// void signalLoop();
 
 };
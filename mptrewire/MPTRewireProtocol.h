@@ -0,0 +1,142 @@
+#pragma once
+#include <stdint.h>
+
+// Messages exchanged between the panel (OpenMPT) and the device (loaded by the mixer)
+
+#define PIPE_EVENTS 0
+#define PIPE_RT     1  // realtime audio thread
+#define PIPE_SIZE_RT (8192 * 2 * sizeof(int32_t))
+
+// A ReWire message size is 16 bits wide, so a batch can never be larger than this
+#define MPT_MAX_BATCH_SIZE (PIPE_SIZE_RT < 0xFFFF ? PIPE_SIZE_RT : 0xFFFF)
+
+// For the same reason a channel travels in chunks of at most this many bytes of audio once it outgrows a message,
+// e.g. 8192 stereo frames. Only the first chunk is preceded by its MPTAudioResponse, the others are plain audio;
+// both sides derive the chunk sizes from framesToRender. Every chunk holds whole frames, see MPTMaxChunkSize().
+#define MPT_MAX_CHUNK_SIZE 0x8000
+
+// Transport capabilities, offered by the device in MPTAudioRequest::capabilities
+// and echoed in MPTAudioResponseHeader::flags for the one the panel actually used.
+#define MPT_CAP_SHARED_MEMORY (1 << 0)  // header and channels are in the next slot of the shared audio ring, no message is sent
+#define MPT_CAP_BATCHED       (1 << 1)  // channels directly follow the header in the same message
+#define MPT_CAP_FLOAT32       (1 << 2)  // channels hold interleaved float samples instead of MIXING_SCALEF fixed point
+#define MPT_CAP_OFFLINE       (1 << 3)  // request only: the mixer bounces, favour throughput and do not wait for acknowledgements
+#define MPT_CAP_PACKED24      (1 << 4)  // pipe transports only: channels hold 3-byte little-endian samples, full scale at 2^23
+#define MPT_CAP_PACKED16      (1 << 5)  // pipe transports only: channels hold int16 samples, dithered by the panel
+#define MPT_CAP_CREDITS       (1 << 6)  // header only: channel messages flow by MPTAudioRequest::credits, see below
+
+// Bytes of one interleaved stereo frame of a channel in the format given by the MPT_CAP_* flags of its block
+inline uint32_t MPTPayloadFrameSize(uint32_t flags)
+{
+	if(flags & MPT_CAP_PACKED16) return 2 * sizeof(int16_t);
+	if(flags & MPT_CAP_PACKED24) return 2 * 3;
+	return 2 * sizeof(int32_t);
+}
+
+// Largest chunk of whole frames
+inline uint32_t MPTMaxChunkSize(uint32_t frameSize)
+{
+	return MPT_MAX_CHUNK_SIZE - MPT_MAX_CHUNK_SIZE % frameSize;
+}
+
+
+// These get sent to the device as commands to the mixer
+enum class MPTPanelEvent
+{
+	Play = 0,
+	Stop = 1,
+	ChangeBPM = 2,
+	Reposition = 3
+};
+
+// Every event starts with these fields. framePosition is the panel's render position
+// (see MPTAudioResponseHeader::renderPosition) plus the event's offset into that block.
+typedef struct
+{
+	uint8_t type;
+	uint32_t framePosition;
+} MPTEventRequest;
+
+typedef struct
+{
+	uint8_t type;
+	uint32_t framePosition;
+	uint32_t tempo;
+} MPTPlayRequest;
+
+typedef struct
+{
+	uint8_t type;
+	uint32_t framePosition;
+	uint32_t tempo;
+} MPTTempoRequest;
+
+typedef struct
+{
+	uint8_t type;
+	uint32_t framePosition;
+	uint32_t position15360PPQ;
+} MPTRepositionRequest;
+
+// The mixer's transport, from ReWireDriveAudioInputParams
+typedef struct
+{
+	uint32_t playMode;           // kReWirePlayMode*, 0 is stopped
+	uint32_t tempo;              // BPM * 1000
+	int32_t ppq15360Position;    // where the requested block starts in the mixer's song, loops included
+	uint32_t signatureNumerator;
+	uint32_t signatureDenominator;
+} MPTTransportState;
+
+typedef struct
+{
+	int32_t sampleRate;
+	int32_t maxBufferSize;
+	uint32_t framesToRender;
+	uint32_t sequence;      // incremented by the device for every block
+	uint32_t capabilities;  // MPT_CAP_* flags the device can handle
+	uint32_t renderAhead;   // blocks the device plays behind this request, 0 = lockstep. See MPT_MAX_RENDER_AHEAD.
+	MPTTransportState transport;
+	uint32_t credits;       // messages the panel may have in flight on the per-channel path, 0 = stop-and-wait
+} MPTAudioRequest;
+
+// Credit-based flow control on the per-channel path: the header and every message after it use up a credit, and the
+// device counts the messages it has consumed in MPTSharedControlHeader::consumedMessages instead of acknowledging
+// each one. The panel only waits when it runs out of credits; the device wakes it whenever another half of them
+// has come back. Needs the shared control region.
+// The device grants as many of the largest message as half the pipe holds, so the window fits as long as the pipe
+// spends no more on a message than the message itself; stop-and-wait relies on as much for the header and the
+// largest chunk. Should the pipe still be full, the panel retries until the device has made room.
+#define MPT_CREDIT_MESSAGE_FACTOR 2
+
+// With render-ahead the device keeps this many requests outstanding and plays the oldest answered one,
+// so the panel renders the next block while the mixer processes the current one. Needs the shared audio ring.
+#define MPT_MAX_RENDER_AHEAD 2
+// While the mixer bounces latency does not matter, and the panel may run as far ahead as the ring allows
+#define MPT_OFFLINE_RENDER_AHEAD 3
+// Largest block the panel may ask to render while the mixer calls the device with smaller ones.
+// The device then serves several callbacks from one block, without any messages in between.
+#define MPT_MAX_RENDER_QUANTUM 2048
+
+typedef struct
+{
+	int32_t sampleRate;
+	int32_t maxBufferSize;
+} MPTAudioInfoRequest;
+
+typedef struct
+{
+	uint32_t servedChannelsBitfield[4];  // 128 bits, one stereo channel for each bit
+	uint32_t silentChannelsBitfield[4];  // rendered but all zero, so not served and not transmitted
+	uint32_t flags;                      // MPT_CAP_* transport used for the channels of this block
+	uint32_t renderPosition;             // frames the panel rendered before this block, wraps around
+} MPTAudioResponseHeader;                // sent once before a bunch of MPTAudioResponse packets are sent
+                                         // With MPT_CAP_BATCHED it is followed by the interleaved audio of
+                                         // every served channel in ascending order, without MPTAudioResponse.
+
+typedef struct
+{
+	uint16_t channelIndex;  // @TODO: optimize this away for performance reasons, then this struct becomes:
+							//        typedef int32_t* MPTAudioResponse;
+	// <interleaved audio channel (2 * fFramesToRender * sizeof(int))>
+} MPTAudioResponse;
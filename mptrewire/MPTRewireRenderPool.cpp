@@ -0,0 +1,139 @@
+#include "MPTRewireRenderPool.h"
+#include "MPTRewireWait.h"
+
+
+
+/*******************************************************************************
+ *
+ * Workers
+ *
+ ******************************************************************************/
+
+void MPTRenderPool::start(int workerCount, const MPTThreadOptions &threadOptions)
+{
+	stop();
+	if(workerCount > MPT_RENDER_POOL_MAX_WORKERS) workerCount = MPT_RENDER_POOL_MAX_WORKERS;
+	if(workerCount < 0) workerCount = 0;
+
+	m_ThreadOptions = threadOptions;
+	m_Quit.store(false, std::memory_order_relaxed);
+	// Spinning on a single core only keeps the thread we wait for from running
+	m_SpinNs = (std::thread::hardware_concurrency() > 1) ? MPT_RENDER_POOL_SPIN_NS : 0;
+	for(m_WorkerCount = 0; m_WorkerCount < workerCount; m_WorkerCount++)
+		m_Workers[m_WorkerCount] = std::thread(&MPTRenderPool::workerProc, this, m_WorkerCount + 1);
+}
+
+void MPTRenderPool::stop()
+{
+	m_Quit.store(true, std::memory_order_release);
+	m_Generation.fetch_add(1, std::memory_order_seq_cst);
+	MPTWakeLocalWord(m_Generation, true);
+	for(int i = 0; i < m_WorkerCount; i++)
+	{
+		if(m_Workers[i].joinable()) m_Workers[i].join();
+	}
+	m_WorkerCount = 0;
+}
+
+
+void MPTRenderPool::workerProc(int queue)
+{
+	// Workers render under the same deadline as the audio thread, so they get the same priority.
+	// Their affinity is their own: the audio thread's mask would pile the whole pool onto its CPUs.
+	void *revertToken = nullptr;
+	MPTEnterRealTime(m_ThreadOptions, &revertToken);
+	MPTSetThreadAffinity(m_ThreadOptions.affinityMask);
+
+	// Missing a block started before we got here is fine, the others take our queue
+	uint32_t generation = m_Generation.load(std::memory_order_acquire);
+	for(;;)
+	{
+		if(!MPTSpinWhileEqual(m_Generation, generation, m_SpinNs))
+		{
+			// Announce that we sleep before checking a last time, so run() either sees us or we see its block
+			m_Sleepers.fetch_add(1, std::memory_order_seq_cst);
+			while(generation == m_Generation.load(std::memory_order_seq_cst))
+				MPTSleepOnLocalWord(m_Generation, generation, MPT_RENDER_POOL_SLEEP_MS);
+			m_Sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+		generation = m_Generation.load(std::memory_order_acquire);
+		if(m_Quit.load(std::memory_order_acquire)) break;
+
+		// We may have woken up so late that run() has already returned, and the queues could be
+		// reset under our feet; announcing ourselves first makes run() wait for us instead
+		m_Busy.fetch_add(1, std::memory_order_seq_cst);
+		if(m_Active.load(std::memory_order_seq_cst)) runQueues(queue);
+		if(1 == m_Busy.fetch_sub(1, std::memory_order_seq_cst) && m_WaitingForBusy.load(std::memory_order_seq_cst))
+			MPTWakeLocalWord(m_Busy, false);
+	}
+
+	MPTLeaveRealTime(revertToken);
+}
+
+
+void MPTRenderPool::runQueues(int queue)
+{
+	// Our own queue first, then steal from the others, one task at a time
+	const int queueCount = m_WorkerCount + 1;
+	for(int i = 0; i < queueCount; i++)
+	{
+		MPTRenderQueue &victim = m_Queues[(queue + i) % queueCount];
+		for(uint32_t task = victim.next.fetch_add(1, std::memory_order_relaxed); task < victim.end; task = victim.next.fetch_add(1, std::memory_order_relaxed))
+			m_Task(task, m_Context);
+	}
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Rendering a block
+ *
+ ******************************************************************************/
+
+void MPTRenderPool::run(uint32_t taskCount, MPTRenderTask task, void *context)
+{
+	if(taskCount > MPT_RENDER_POOL_MAX_TASKS) taskCount = MPT_RENDER_POOL_MAX_TASKS;
+	if(0 == m_WorkerCount || taskCount <= 1)
+	{
+		for(uint32_t i = 0; i < taskCount; i++) task(i, context);
+		return;
+	}
+
+	// Contiguous ranges, so that neighbouring groups tend to end up on the same thread
+	m_Task = task;
+	m_Context = context;
+	const uint32_t queueCount = (uint32_t)m_WorkerCount + 1;
+	for(uint32_t queue = 0; queue < queueCount; queue++)
+	{
+		m_Queues[queue].next.store(taskCount * queue / queueCount, std::memory_order_relaxed);
+		m_Queues[queue].end = taskCount * (queue + 1) / queueCount;
+	}
+	m_Active.store(true, std::memory_order_seq_cst);
+
+	// Workers still spinning pick the block up by themselves, only sleepers cost a system call
+	m_Generation.fetch_add(1, std::memory_order_seq_cst);
+	if(m_Sleepers.load(std::memory_order_seq_cst)) MPTWakeLocalWord(m_Generation, true);
+
+	// Pitch in; once we run out of work every task has been taken, so we only wait for those still running
+	runQueues(0);
+	m_Active.store(false, std::memory_order_seq_cst);
+	if(m_Busy.load(std::memory_order_seq_cst)) waitForStragglers();
+}
+
+
+void MPTRenderPool::waitForStragglers()
+{
+	// They are in the middle of their last task, usually done by the time we have spun a little
+	for(uint32_t busy = m_Busy.load(std::memory_order_seq_cst); busy; busy = m_Busy.load(std::memory_order_seq_cst))
+	{
+		if(MPTSpinWhileEqual(m_Busy, busy, m_SpinNs)) continue;
+
+		// The last one out wakes us if it sees this, or we see that it is gone
+		m_WaitingForBusy.store(true, std::memory_order_seq_cst);
+		if(busy == m_Busy.load(std::memory_order_seq_cst))
+			MPTSleepOnLocalWord(m_Busy, busy, MPT_RENDER_POOL_SLEEP_MS);
+		m_WaitingForBusy.store(false, std::memory_order_relaxed);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+#include "MPTRewireThread.h"
+
+// A small pool of workers that share the rendering of one block with the panel's audio thread.
+// Every block is a fixed set of tasks, split evenly into one queue per thread up front. A thread works through
+// its own queue first and then steals from the others, so one expensive channel group does not hold up the rest.
+// run() is called on the audio thread, so it never takes a lock: it publishes the block through an atomic
+// generation and only makes a system call to wake workers that went to sleep on it, see MPTRewireWait.h.
+
+#define MPT_RENDER_POOL_MAX_WORKERS 15
+#define MPT_RENDER_POOL_MAX_TASKS   128
+#define MPT_RENDER_POOL_SPIN_NS     20000  // how long workers wait for the next block, and run() for stragglers, before sleeping
+#define MPT_RENDER_POOL_SLEEP_MS    100    // sleepers check again after this long, just in case
+
+
+typedef void (*MPTRenderTask)(uint32_t task, void *context);
+
+typedef struct
+{
+	alignas(64) std::atomic<uint32_t> next;  // taken by the owner and by thieves alike
+	uint32_t end;
+} MPTRenderQueue;
+
+
+class MPTRenderPool
+{
+private:
+	std::thread m_Workers[MPT_RENDER_POOL_MAX_WORKERS];
+	int m_WorkerCount = 0;
+	MPTThreadOptions m_ThreadOptions;
+	MPTRenderQueue m_Queues[MPT_RENDER_POOL_MAX_WORKERS + 1];  // the caller of run() owns queue 0
+
+	// The block that is being rendered
+	MPTRenderTask m_Task = nullptr;
+	void *m_Context = nullptr;
+
+	uint64_t m_SpinNs = 0;
+	alignas(64) std::atomic<uint32_t> m_Generation{0};  // bumped for every block and to quit, workers sleep on it
+	std::atomic<uint32_t> m_Sleepers{0};                // workers that sleep on m_Generation, or are about to
+	std::atomic<bool> m_Quit{false};
+	std::atomic<bool> m_Active{false};                  // queues may be taken from
+	alignas(64) std::atomic<uint32_t> m_Busy{0};        // workers that might be taking from the queues, run() sleeps on it
+	std::atomic<bool> m_WaitingForBusy{false};          // run() sleeps on m_Busy, or is about to
+
+	void workerProc(int worker);
+	void runQueues(int queue);
+	void waitForStragglers();
+
+public:
+	~MPTRenderPool() { stop(); }
+
+	// 0 workers is fine, run() then does all the work on the calling thread
+	void start(int workerCount, const MPTThreadOptions &threadOptions);
+	void stop();
+	int workerCount() const { return m_WorkerCount; }
+
+	// Calls task(0 .. taskCount - 1) on the calling thread and the workers, returns once every call returned
+	void run(uint32_t taskCount, MPTRenderTask task, void *context);
+};
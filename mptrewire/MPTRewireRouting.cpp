@@ -0,0 +1,152 @@
+#include "MPTRewireRouting.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/*******************************************************************************
+ *
+ * Sources
+ *
+ ******************************************************************************/
+
+static void SourceName(int source, char *name, size_t nameSize)
+{
+	if(source < MPT_ROUTING_CHANNELS) snprintf(name, nameSize, "c%i", source + 1);
+	else if(source < MPT_ROUTING_PREVIEW_SOURCE) snprintf(name, nameSize, "p%i", source - MPT_ROUTING_CHANNELS + 1);
+	else snprintf(name, nameSize, "preview");
+}
+
+// Returns -1 for anything that is not a source
+static int ParseSource(const char *token)
+{
+	if(!strcmp(token, "preview")) return MPT_ROUTING_PREVIEW_SOURCE;
+	if(('c' != token[0] && 'p' != token[0]) || !isdigit((unsigned char)token[1])) return -1;
+
+	char *end = nullptr;
+	const long number = strtol(token + 1, &end, 10);
+	if(*end) return -1;
+	if('c' == token[0]) return (number >= 1 && number <= MPT_ROUTING_CHANNELS) ? (int)number - 1 : -1;
+	return (number >= 1 && number <= MPT_ROUTING_PLUGINS) ? MPT_ROUTING_CHANNELS + (int)number - 1 : -1;
+}
+
+static char *Trim(char *text)
+{
+	while(isspace((unsigned char)*text)) text++;
+	char *end = text + strlen(text);
+	while(end > text && isspace((unsigned char)end[-1])) *--end = '\0';
+	return text;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Maps
+ *
+ ******************************************************************************/
+
+void MPTDefaultRoutingMap(MPTRoutingMap &map)
+{
+	memset(&map, 0, sizeof(map));
+	map.busCount = MPT_ROUTING_SOURCES;
+	for(int source = 0; source < MPT_ROUTING_SOURCES; source++)
+	{
+		map.sourceBus[source] = (uint8_t)source;
+		if(source < MPT_ROUTING_CHANNELS) snprintf(map.busNames[source], MPT_ROUTING_NAME_SIZE, "Channel %i", source + 1);
+		else if(source < MPT_ROUTING_PREVIEW_SOURCE) snprintf(map.busNames[source], MPT_ROUTING_NAME_SIZE, "Plugin %i", source - MPT_ROUTING_CHANNELS + 1);
+		else snprintf(map.busNames[source], MPT_ROUTING_NAME_SIZE, "Preview");
+	}
+}
+
+
+bool MPTLoadRoutingMap(const char *path, MPTRoutingMap &map)
+{
+	FILE *file = fopen(path, "r");
+	if(!file) return false;
+
+	MPTRoutingMap loaded;
+	memset(&loaded, 0, sizeof(loaded));
+	memset(loaded.sourceBus, MPT_ROUTING_UNROUTED, sizeof(loaded.sourceBus));
+	char line[1024];
+	while(fgets(line, sizeof(line), file) && loaded.busCount < MPT_ROUTING_MAX_BUSES)
+	{
+		char *separator = strchr(line, '=');
+		const char *name = Trim(line);
+		if('#' == *name || !separator) continue;
+		*separator = '\0';
+		name = Trim(line);
+		if(!*name) continue;
+
+		// A source feeds a single bus, the first one that claims it
+		const uint8_t bus = (uint8_t)loaded.busCount++;
+		strncpy(loaded.busNames[bus], name, MPT_ROUTING_NAME_SIZE - 1);
+		for(char *token = strtok(separator + 1, " \t\r\n,"); token; token = strtok(nullptr, " \t\r\n,"))
+		{
+			const int source = ParseSource(token);
+			if(source >= 0 && MPT_ROUTING_UNROUTED == loaded.sourceBus[source]) loaded.sourceBus[source] = bus;
+		}
+	}
+	fclose(file);
+
+	if(!loaded.busCount) return false;
+	map = loaded;
+	return true;
+}
+
+
+bool MPTSaveRoutingMap(const char *path, const MPTRoutingMap &map)
+{
+	FILE *file = fopen(path, "w");
+	if(!file) return false;
+
+	fprintf(file, "# OpenMPT ReWire channels, one per line: <name> = <sources>\n");
+	fprintf(file, "# Sources are c1 .. c%i (channels), p1 .. p%i (plugins) and preview; several of them are summed.\n",
+		MPT_ROUTING_CHANNELS, MPT_ROUTING_PLUGINS);
+	for(uint32_t bus = 0; bus < map.busCount && bus < MPT_ROUTING_MAX_BUSES; bus++)
+	{
+		fprintf(file, "%.*s =", MPT_ROUTING_NAME_SIZE, map.busNames[bus]);
+		for(int source = 0; source < MPT_ROUTING_SOURCES; source++)
+		{
+			if(map.sourceBus[source] != bus) continue;
+			char sourceName[16];
+			SourceName(source, sourceName, sizeof(sourceName));
+			fprintf(file, " %s", sourceName);
+		}
+		fprintf(file, "\n");
+	}
+	return 0 == fclose(file);
+}
+
+
+void MPTRoutingMapPath(const char *moduleFileName, char *path, size_t pathSize)
+{
+	const char *slash = strrchr(moduleFileName, '\\');
+	if(!slash || (strrchr(moduleFileName, '/') && strrchr(moduleFileName, '/') > slash)) slash = strrchr(moduleFileName, '/');
+	const int directoryLength = slash ? (int)(slash - moduleFileName + 1) : 0;
+	snprintf(path, pathSize, "%.*s%s", directoryLength, moduleFileName, MPT_ROUTING_MAP_FILE);
+}
+
+
+uint64_t MPTRoutedSources(const MPTRoutingMap &map)
+{
+	uint64_t sources = 0;
+	for(int source = 0; source < MPT_ROUTING_SOURCES; source++)
+	{
+		if(map.sourceBus[source] < map.busCount) sources |= (uint64_t)1 << source;
+	}
+	return sources;
+}
+
+bool MPTIsIdentityRouting(const MPTRoutingMap &map)
+{
+	if(MPT_ROUTING_SOURCES != map.busCount) return false;
+	for(int source = 0; source < MPT_ROUTING_SOURCES; source++)
+	{
+		if(map.sourceBus[source] != source) return false;
+	}
+	return true;
+}
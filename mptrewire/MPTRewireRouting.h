@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Which of OpenMPT's stereo outputs (sources) go to which ReWire channel (bus).
+// The device reads the map when the mixer loads it and advertises one stereo channel per bus, under the bus's name;
+// it then hands the map to the panel through the shared region. Sources routed to the same bus are summed by the
+// panel, unrouted ones are not transferred at all. Without a map file every source gets a bus of its own.
+//
+// The map file lives next to the device and holds one bus per line, "<name> = <sources>", where the sources are
+// c1 .. c32 for OpenMPT's channels, p1 .. p31 for its plugins and "preview". Lines starting with # are ignored:
+//
+//   Drums = c1 c2 c3
+//   Pads = p1 p4
+//   Preview = preview
+
+#define MPT_ROUTING_MAP_FILE       "MPTRewire.routing"
+#define MPT_ROUTING_SOURCES        64    // kReWireAudioChannelCount / 2
+#define MPT_ROUTING_CHANNELS       32    // sources 0 .. 31
+#define MPT_ROUTING_PLUGINS        31    // sources 32 .. 62
+#define MPT_ROUTING_PREVIEW_SOURCE 63
+#define MPT_ROUTING_MAX_BUSES      MPT_ROUTING_SOURCES
+#define MPT_ROUTING_NAME_SIZE      32    // as ReWireDeviceInfo::fChannelNames
+#define MPT_ROUTING_UNROUTED       0xFF
+
+
+typedef struct
+{
+	uint32_t busCount;
+	uint8_t sourceBus[MPT_ROUTING_SOURCES];  // bus every source is summed into, MPT_ROUTING_UNROUTED if none
+	char busNames[MPT_ROUTING_MAX_BUSES][MPT_ROUTING_NAME_SIZE];
+} MPTRoutingMap;
+
+
+void MPTDefaultRoutingMap(MPTRoutingMap &map);
+// Both leave the map alone and return false if the file cannot be read, or holds no bus at all
+bool MPTLoadRoutingMap(const char *path, MPTRoutingMap &map);
+bool MPTSaveRoutingMap(const char *path, const MPTRoutingMap &map);
+// The map file's path in the directory of moduleFileName
+void MPTRoutingMapPath(const char *moduleFileName, char *path, size_t pathSize);
+
+uint64_t MPTRoutedSources(const MPTRoutingMap &map);  // one bit per source
+bool MPTIsIdentityRouting(const MPTRoutingMap &map);  // every source on the bus of the same index
+
+// Takes the lowest source out of a non-empty set of them, so that a block only visits the sources it has to
+inline int MPTNextSource(uint64_t &sources)
+{
+#ifdef _MSC_VER
+	unsigned long source;
+	_BitScanForward64(&source, sources);
+#else
+	const int source = __builtin_ctzll(sources);
+#endif
+	sources &= sources - 1;
+	return (int)source;
+}
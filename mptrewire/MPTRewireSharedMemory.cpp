@@ -0,0 +1,352 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "MPTRewireSharedMemory.h"
+#include <new>
+#include <string.h>
+
+
+
+/*******************************************************************************
+ *
+ * Mapping a region
+ *
+ ******************************************************************************/
+
+bool MPTSharedMapping::map(bool create, size_t size)
+{
+#ifdef _WIN32
+	if(create)
+	{
+		m_MappingHandle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF), m_Name);
+	} else
+	{
+		m_MappingHandle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, m_Name);
+	}
+	if(!m_MappingHandle) return false;
+
+	// A size of 0 maps the entire section, which is what the panel wants
+	void *view = MapViewOfFile(m_MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, create ? size : 0);
+	if(!view)
+	{
+		CloseHandle(m_MappingHandle);
+		m_MappingHandle = nullptr;
+		return false;
+	}
+#else
+	m_MappingFd = shm_open(m_Name, create ? (O_CREAT | O_RDWR) : O_RDWR, 0600);
+	if(m_MappingFd < 0) return false;
+
+	if(create)
+	{
+		if(0 != ftruncate(m_MappingFd, (off_t)size))
+		{
+			::close(m_MappingFd);
+			m_MappingFd = -1;
+			shm_unlink(m_Name);
+			return false;
+		}
+	} else
+	{
+		// The panel does not know the size up front, the device decided it
+		struct stat st;
+		if(0 != fstat(m_MappingFd, &st) || (size_t)st.st_size < size)
+		{
+			::close(m_MappingFd);
+			m_MappingFd = -1;
+			return false;
+		}
+		size = (size_t)st.st_size;
+	}
+
+	void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_MappingFd, 0);
+	if(MAP_FAILED == view)
+	{
+		::close(m_MappingFd);
+		m_MappingFd = -1;
+		if(create) shm_unlink(m_Name);
+		return false;
+	}
+#endif
+
+	m_View = view;
+	m_Size = size;
+	m_Owner = create;
+#ifdef _WIN32
+	if(!create)
+	{
+		// The section may be larger than what the device asked for, go by what we actually mapped
+		MEMORY_BASIC_INFORMATION info;
+		if(VirtualQuery(view, &info, sizeof(info))) m_Size = info.RegionSize;
+		if(m_Size < size)
+		{
+			close();
+			return false;
+		}
+	}
+#endif
+	return true;
+}
+
+
+bool MPTSharedMapping::create(const char *name, size_t size)
+{
+	close();
+	strncpy(m_Name, name, sizeof(m_Name) - 1);
+	return map(true, size);
+}
+
+bool MPTSharedMapping::open(const char *name, size_t minSize)
+{
+	close();
+	strncpy(m_Name, name, sizeof(m_Name) - 1);
+	return map(false, minSize);
+}
+
+bool MPTSharedMapping::lock()
+{
+	if(!m_View) return false;
+	if(!m_Locked) m_Locked = MPTLockMemory(m_View, m_Size);
+	return m_Locked;
+}
+
+void MPTSharedMapping::prefault()
+{
+	MPTPrefaultMemory(m_View, m_Size);
+}
+
+
+void MPTSharedMapping::close()
+{
+	if(m_View)
+	{
+		MPTUnlockMemory(m_View, m_Size, m_Locked);
+		m_Locked = false;
+#ifdef _WIN32
+		UnmapViewOfFile(m_View);
+#else
+		munmap(m_View, m_Size);
+#endif
+		m_View = nullptr;
+	}
+#ifdef _WIN32
+	if(m_MappingHandle)
+	{
+		CloseHandle(m_MappingHandle);
+		m_MappingHandle = nullptr;
+	}
+#else
+	if(m_MappingFd >= 0)
+	{
+		::close(m_MappingFd);
+		m_MappingFd = -1;
+		if(m_Owner) shm_unlink(m_Name);
+	}
+#endif
+	m_Size = 0;
+	m_Owner = false;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Control region
+ *
+ ******************************************************************************/
+
+bool MPTSharedControl::create(const char *name, const MPTRoutingMap &routing)
+{
+	close();
+	if(!m_Mapping.create(name, sizeof(MPTSharedControlHeader))) return false;
+	// Both sides wake each other and count credits through it on their real-time threads
+	m_Mapping.lock();
+
+	m_Header = new(m_Mapping.data()) MPTSharedControlHeader();
+	m_Header->version = MPT_SHARED_RING_VERSION;
+	m_Header->headerSize = sizeof(MPTSharedControlHeader);
+	m_Header->routing = routing;
+	m_Header->signalToPanel.state.store(MPT_SIGNAL_EMPTY, std::memory_order_relaxed);
+	m_Header->signalToDevice.state.store(MPT_SIGNAL_EMPTY, std::memory_order_relaxed);
+	m_Header->channelsZeroed.store(0, std::memory_order_relaxed);
+	m_Header->channelsZeroingAvoided.store(0, std::memory_order_relaxed);
+	m_Header->bytesZeroingAvoided.store(0, std::memory_order_relaxed);
+	m_Header->renderAheadLatencyFrames.store(0, std::memory_order_relaxed);
+	m_Header->renderQuantumLatencyFrames.store(0, std::memory_order_relaxed);
+	m_Header->maxBufferSize.store(0, std::memory_order_relaxed);
+	m_Header->audioRingReady.store(0, std::memory_order_relaxed);
+	m_Header->lockedMemoryBytes.store(0, std::memory_order_relaxed);
+	m_Header->unlockedMemoryBytes.store(0, std::memory_order_relaxed);
+	m_Header->hugePageBytes.store(0, std::memory_order_relaxed);
+	m_Header->consumedMessages.store(0, std::memory_order_relaxed);
+	MPTResetDeviceTiming(m_Header->deviceTiming);
+	m_Header->requestedRenderAhead.store(0, std::memory_order_relaxed);
+	m_Header->panelUsesSignals.store(0, std::memory_order_relaxed);
+	m_Header->spinWaitEnabled.store(1, std::memory_order_relaxed);
+	m_Header->offlineRenderAhead.store(0, std::memory_order_relaxed);
+	m_Header->offlineDetection.store(1, std::memory_order_relaxed);
+	m_Header->requestedRenderQuantum.store(0, std::memory_order_relaxed);
+	m_Header->audioRingRequested.store(0, std::memory_order_relaxed);
+
+	// Publish the magic last so that a panel never sees a half-initialized header
+	std::atomic_thread_fence(std::memory_order_release);
+	m_Header->magic = MPT_SHARED_CONTROL_MAGIC;
+	return true;
+}
+
+
+// The regions have fixed names, so they may as well be left over from a crashed device or come from another build.
+// Nothing in a header is trusted before it has been checked against this build and the size of the mapping.
+bool MPTSharedControl::open(const char *name)
+{
+	close();
+	if(!m_Mapping.open(name, sizeof(MPTSharedControlHeader))) return false;
+
+	m_Header = reinterpret_cast<MPTSharedControlHeader *>(m_Mapping.data());
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(MPT_SHARED_CONTROL_MAGIC != m_Header->magic || MPT_SHARED_RING_VERSION != m_Header->version
+		|| sizeof(MPTSharedControlHeader) != m_Header->headerSize
+		|| !m_Header->routing.busCount || m_Header->routing.busCount > MPT_ROUTING_MAX_BUSES)
+	{
+		close();
+		return false;
+	}
+	m_Mapping.prefault();
+	return true;
+}
+
+
+void MPTSharedControl::close()
+{
+	m_Mapping.close();
+	m_Header = nullptr;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Audio ring
+ *
+ ******************************************************************************/
+
+bool MPTSharedAudioRing::create(const char *name, uint32_t channelCount, uint32_t maxFrames)
+{
+	close();
+	uint32_t channelStride = maxFrames * 2 * sizeof(int32_t);
+	channelStride = (channelStride + MPT_CACHE_LINE_SIZE - 1) & ~(uint32_t)(MPT_CACHE_LINE_SIZE - 1);
+	uint32_t slotSize = sizeof(MPTSharedRingSlot) + channelCount * channelStride;
+	size_t size = sizeof(MPTSharedRingHeader) + (size_t)MPT_SHARED_RING_SLOTS * slotSize;
+	if(!m_Mapping.create(name, size)) return false;
+	// The panel renders into and we read from the slots on our real-time threads
+	m_Mapping.lock();
+
+	m_Header = new(m_Mapping.data()) MPTSharedRingHeader();
+	m_Header->version = MPT_SHARED_RING_VERSION;
+	m_Header->headerSize = sizeof(MPTSharedRingHeader);
+	m_Header->slotCount = MPT_SHARED_RING_SLOTS;
+	m_Header->channelCount = channelCount;
+	m_Header->slotSize = slotSize;
+	m_Header->channelStride = channelStride;
+	m_Header->writeIndex.store(0, std::memory_order_relaxed);
+	m_Header->readIndex.store(0, std::memory_order_relaxed);
+	m_Slots = reinterpret_cast<uint8_t *>(m_Header) + sizeof(MPTSharedRingHeader);
+
+	std::atomic_thread_fence(std::memory_order_release);
+	m_Header->magic = MPT_SHARED_RING_MAGIC;
+	return true;
+}
+
+
+bool MPTSharedAudioRing::isLayoutValid() const
+{
+	const MPTSharedRingHeader &header = *m_Header;
+	if(MPT_SHARED_RING_VERSION != header.version || sizeof(MPTSharedRingHeader) != header.headerSize) return false;
+	if(!header.slotCount || !header.channelCount || header.channelCount > MPT_ROUTING_MAX_BUSES) return false;
+	if(header.channelStride < 2 * sizeof(int32_t) || header.channelStride % MPT_CACHE_LINE_SIZE) return false;
+	if(header.slotSize < sizeof(MPTSharedRingSlot) + (uint64_t)header.channelCount * header.channelStride
+		|| header.slotSize % alignof(MPTSharedRingSlot)) return false;
+	return sizeof(MPTSharedRingHeader) + (uint64_t)header.slotCount * header.slotSize <= m_Mapping.size();
+}
+
+
+bool MPTSharedAudioRing::open(const char *name)
+{
+	close();
+	if(!m_Mapping.open(name, sizeof(MPTSharedRingHeader))) return false;
+
+	m_Header = reinterpret_cast<MPTSharedRingHeader *>(m_Mapping.data());
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(MPT_SHARED_RING_MAGIC != m_Header->magic || !isLayoutValid())
+	{
+		close();
+		return false;
+	}
+	m_Mapping.prefault();
+	m_Slots = reinterpret_cast<uint8_t *>(m_Header) + sizeof(MPTSharedRingHeader);
+	return true;
+}
+
+
+void MPTSharedAudioRing::close()
+{
+	m_Mapping.close();
+	m_Header = nullptr;
+	m_Slots = nullptr;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Lock-free single-producer / single-consumer ring
+ *
+ ******************************************************************************/
+
+MPTSharedRingSlot *MPTSharedAudioRing::acquireWriteSlot()
+{
+	uint32_t writeIndex = m_Header->writeIndex.load(std::memory_order_relaxed);
+	uint32_t readIndex = m_Header->readIndex.load(std::memory_order_acquire);
+	if(writeIndex - readIndex >= m_Header->slotCount)
+		return nullptr;  // ring is full
+
+	return reinterpret_cast<MPTSharedRingSlot *>(m_Slots + (size_t)(writeIndex % m_Header->slotCount) * m_Header->slotSize);
+}
+
+void MPTSharedAudioRing::publishWriteSlot()
+{
+	// Release: the slot's contents become visible before the new write index
+	m_Header->writeIndex.fetch_add(1, std::memory_order_release);
+}
+
+
+const MPTSharedRingSlot *MPTSharedAudioRing::peekReadSlot()
+{
+	uint32_t readIndex = m_Header->readIndex.load(std::memory_order_relaxed);
+	uint32_t writeIndex = m_Header->writeIndex.load(std::memory_order_acquire);
+	if(readIndex == writeIndex)
+		return nullptr;  // ring is empty
+
+	return reinterpret_cast<const MPTSharedRingSlot *>(m_Slots + (size_t)(readIndex % m_Header->slotCount) * m_Header->slotSize);
+}
+
+void MPTSharedAudioRing::releaseReadSlot()
+{
+	// Release: we are done reading the slot before the panel may overwrite it
+	m_Header->readIndex.fetch_add(1, std::memory_order_release);
+}
+
+void MPTSharedAudioRing::discardPending()
+{
+	m_Header->readIndex.store(m_Header->writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+}
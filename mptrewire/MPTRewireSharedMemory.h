@@ -0,0 +1,175 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "MPTRewireMemory.h"
+#include "MPTRewireProtocol.h"
+#include "MPTRewireRouting.h"
+#include "MPTRewireStats.h"
+#include "MPTRewireWait.h"
+
+// Shared memory between panel and device, in two regions the device creates.
+// The control region carries the routing, settings, statistics, signals and credits. It is small, and both sides
+// map it whichever transport the audio takes.
+// The audio ring only exists once a panel asks for the shared-memory transport. The panel renders straight into it,
+// and blocks are handed over through a single-producer (panel) / single-consumer (device) ring of slots.
+
+#ifdef _WIN32
+#define MPT_SHARED_CONTROL_NAME "OPENMPT_REWIRE_CONTROL"
+#define MPT_SHARED_RING_NAME    "OPENMPT_REWIRE_AUDIO_RING"
+#else
+#define MPT_SHARED_CONTROL_NAME "/openmpt_rewire_control"
+#define MPT_SHARED_RING_NAME    "/openmpt_rewire_audio_ring"
+#endif
+#define MPT_SHARED_CONTROL_MAGIC   0x4D505443  // 'MPTC'
+#define MPT_SHARED_RING_MAGIC      0x4D505452  // 'MPTR'
+#define MPT_SHARED_RING_VERSION    3           // bump whenever one of the layouts below changes
+#define MPT_SHARED_RING_SLOTS      4
+#define MPT_SHARED_RING_MAX_FRAMES 8192        // per slot at most, the device sizes the ring to the mixer's blocks
+#define MPT_CACHE_LINE_SIZE        64
+
+
+static_assert(MPT_OFFLINE_RENDER_AHEAD < MPT_SHARED_RING_SLOTS, "Every outstanding block needs a slot of its own");
+static_assert(MPT_MAX_RENDER_QUANTUM <= MPT_SHARED_RING_MAX_FRAMES, "A render quantum must fit into a slot");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Ring indices must be lock-free to be shared across processes");
+
+// Lives at the start of the control region
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;        // MPT_SHARED_RING_VERSION of the device that created the region
+	uint32_t headerSize;     // sizeof(MPTSharedControlHeader) as the device sees it
+	MPTRoutingMap routing;   // what the device advertised to the mixer
+	alignas(MPT_CACHE_LINE_SIZE) MPTSharedSignal signalToPanel;
+	alignas(MPT_CACHE_LINE_SIZE) MPTSharedSignal signalToDevice;
+
+	// Device statistics, only written by the device
+	alignas(MPT_CACHE_LINE_SIZE) std::atomic<uint64_t> channelsZeroed;          // unserved stereo channels that needed zeroing
+	std::atomic<uint64_t> channelsZeroingAvoided;                               // unserved stereo channels that were still zero
+	std::atomic<uint64_t> bytesZeroingAvoided;
+	std::atomic<uint32_t> renderAheadLatencyFrames;                             // latency added by render-ahead
+	std::atomic<uint32_t> renderQuantumLatencyFrames;                           // latency added by the render quantum
+	std::atomic<uint32_t> maxBufferSize;                                        // frames, as the mixer announced it
+	std::atomic<uint32_t> audioRingReady;                                       // nonzero: the audio ring exists and may be mapped
+	std::atomic<uint64_t> lockedMemoryBytes;                                    // see MPTLockedMemoryStats
+	std::atomic<uint64_t> unlockedMemoryBytes;
+	std::atomic<uint64_t> hugePageBytes;
+	alignas(MPT_CACHE_LINE_SIZE) std::atomic<uint32_t> consumedMessages;        // of the current block, see MPT_CAP_CREDITS
+	alignas(MPT_CACHE_LINE_SIZE) MPTDeviceTiming deviceTiming;
+
+	// Settings, only written by the panel
+	alignas(MPT_CACHE_LINE_SIZE) std::atomic<uint32_t> requestedRenderAhead;    // see MPT_MAX_RENDER_AHEAD
+	std::atomic<uint32_t> panelUsesSignals;     // nonzero: both sides wake each other through the signals above
+	std::atomic<uint32_t> spinWaitEnabled;      // nonzero: the device may spin while it waits for the panel
+	std::atomic<uint32_t> offlineRenderAhead;   // depth to render ahead at while the mixer bounces
+	std::atomic<uint32_t> offlineDetection;     // nonzero: the device may switch to throughput mode on its own
+	std::atomic<uint32_t> requestedRenderQuantum;  // frames, 0 for none, see MPT_MAX_RENDER_QUANTUM
+	std::atomic<uint32_t> audioRingRequested;   // nonzero: the panel wants the shared-memory transport
+} MPTSharedControlHeader;
+
+// Lives at the start of the audio ring
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;        // MPT_SHARED_RING_VERSION of the device that created the ring
+	uint32_t headerSize;     // sizeof(MPTSharedRingHeader) as the device sees it
+	uint32_t slotCount;
+	uint32_t channelCount;   // stereo channels per slot, one per bus of the routing map
+	uint32_t slotSize;       // bytes per slot, including the MPTSharedRingSlot header
+	uint32_t channelStride;  // bytes between two interleaved stereo channels within a slot
+	alignas(MPT_CACHE_LINE_SIZE) std::atomic<uint32_t> writeIndex;  // only advanced by the panel
+	alignas(MPT_CACHE_LINE_SIZE) std::atomic<uint32_t> readIndex;   // only advanced by the device
+} MPTSharedRingHeader;
+
+// Precedes the channel data of every slot
+typedef struct
+{
+	alignas(MPT_CACHE_LINE_SIZE) uint32_t sequence;  // MPTAudioRequest::sequence this block answers
+	uint32_t framesToRender;
+	MPTAudioResponseHeader responseHeader;           // replaces the header message
+} MPTSharedRingSlot;
+
+
+// A named mapping, created by the device and opened by the panel. The device locks it into RAM for as long as it
+// exists; the panel maps it for a while at most and only faults its view in, the pages stay resident either way.
+class MPTSharedMapping
+{
+private:
+	void *m_View = nullptr;
+	size_t m_Size = 0;
+	bool m_Owner = false;
+	bool m_Locked = false;
+#ifdef _WIN32
+	void *m_MappingHandle = nullptr;
+#else
+	int m_MappingFd = -1;
+#endif
+	char m_Name[64] = { 0 };
+
+	bool map(bool create, size_t size);
+
+public:
+	MPTSharedMapping() = default;
+	MPTSharedMapping(const MPTSharedMapping &) = delete;
+	MPTSharedMapping &operator=(const MPTSharedMapping &) = delete;
+	~MPTSharedMapping() { close(); }
+
+	bool create(const char *name, size_t size);
+	bool open(const char *name, size_t minSize);  // the device decided the size
+	void close();
+	bool isOpen() const { return nullptr != m_View; }
+	void *data() const { return m_View; }
+	size_t size() const { return m_Size; }
+	bool lock();      // device side
+	void prefault();  // panel side
+};
+
+
+class MPTSharedControl
+{
+private:
+	MPTSharedMapping m_Mapping;
+	MPTSharedControlHeader *m_Header = nullptr;
+
+public:
+	bool create(const char *name, const MPTRoutingMap &routing);  // device side
+	bool open(const char *name);                                  // panel side
+	void close();
+	bool isOpen() const { return nullptr != m_Header; }
+	MPTSharedControlHeader *header() const { return m_Header; }
+};
+
+
+class MPTSharedAudioRing
+{
+private:
+	MPTSharedMapping m_Mapping;
+	MPTSharedRingHeader *m_Header = nullptr;
+	uint8_t *m_Slots = nullptr;
+
+	bool isLayoutValid() const;
+
+public:
+	bool create(const char *name, uint32_t channelCount, uint32_t maxFrames);  // device side
+	bool open(const char *name);                                              // panel side
+	void close();
+	bool isOpen() const { return nullptr != m_Header; }
+	uint32_t channelCount() const { return m_Header ? m_Header->channelCount : 0; }
+	uint32_t maxFrames() const { return m_Header ? m_Header->channelStride / (2 * sizeof(int32_t)) : 0; }
+
+	inline int32_t *channel(MPTSharedRingSlot *slot, int channelIndex) const {
+		return reinterpret_cast<int32_t *>(reinterpret_cast<uint8_t *>(slot) + sizeof(MPTSharedRingSlot) + (size_t)channelIndex * m_Header->channelStride);
+	}
+	inline const int32_t *channel(const MPTSharedRingSlot *slot, int channelIndex) const {
+		return channel(const_cast<MPTSharedRingSlot *>(slot), channelIndex);
+	}
+
+	// Producer: returns nullptr when the device has not yet consumed enough slots
+	MPTSharedRingSlot *acquireWriteSlot();
+	void publishWriteSlot();
+
+	// Consumer: returns nullptr when the panel has not published anything
+	const MPTSharedRingSlot *peekReadSlot();
+	void releaseReadSlot();
+	void discardPending();  // drop every published slot, e.g. after a timed out block
+};
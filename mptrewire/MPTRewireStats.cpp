@@ -0,0 +1,151 @@
+#include "MPTRewireStats.h"
+
+
+
+/*******************************************************************************
+ *
+ * Histogram
+ *
+ ******************************************************************************/
+
+uint32_t MPTLatencyHistogram::bucketOf(uint64_t ns)
+{
+	const uint64_t subBuckets = 1 << MPT_HISTOGRAM_SUB_BUCKET_BITS;
+	if(ns < subBuckets) return (uint32_t)ns;
+	if(ns >> MPT_HISTOGRAM_MAX_BITS) return MPT_HISTOGRAM_BUCKETS - 1;
+
+	uint32_t msb = 0;
+	while(ns >> (msb + 1)) msb++;
+	const uint32_t shift = msb - MPT_HISTOGRAM_SUB_BUCKET_BITS;
+	return ((shift + 1) << MPT_HISTOGRAM_SUB_BUCKET_BITS) + (uint32_t)((ns >> shift) & (subBuckets - 1));
+}
+
+uint64_t MPTLatencyHistogram::bucketUpperBound(uint32_t bucket)
+{
+	const uint32_t subBuckets = 1 << MPT_HISTOGRAM_SUB_BUCKET_BITS;
+	if(bucket < subBuckets) return bucket;
+	const uint32_t shift = (bucket >> MPT_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+	const uint64_t subBucket = (bucket & (subBuckets - 1)) | subBuckets;
+	return ((subBucket + 1) << shift) - 1;
+}
+
+
+void MPTLatencyHistogram::reset()
+{
+	for(auto &count : m_Counts) count.store(0, std::memory_order_relaxed);
+	m_Count.store(0, std::memory_order_relaxed);
+	m_SumNs.store(0, std::memory_order_relaxed);
+	m_MaxNs.store(0, std::memory_order_relaxed);
+}
+
+
+void MPTLatencyHistogram::record(uint64_t ns)
+{
+	MPTIncrementCounter(m_Counts[bucketOf(ns)]);
+	m_SumNs.store(m_SumNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	if(ns > m_MaxNs.load(std::memory_order_relaxed)) m_MaxNs.store(ns, std::memory_order_relaxed);
+
+	// Readers take the count as the number of values they can expect in the buckets
+	m_Count.store(m_Count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+/**
+ * Percentiles are reported as the upper bound of the bucket they fall into, capped at the maximum.
+ * The writer may record while we read, so the buckets can hold a few more values than the count says.
+**/
+void MPTLatencyHistogram::summarize(MPTLatencySummary &summary) const
+{
+	summary = MPTLatencySummary();
+	summary.count = m_Count.load(std::memory_order_acquire);
+	if(0 == summary.count) return;
+
+	const uint64_t maxNs = m_MaxNs.load(std::memory_order_relaxed);
+	summary.meanUs = (double)m_SumNs.load(std::memory_order_relaxed) / (double)summary.count / 1000.0;
+	summary.maxUs = (double)maxNs / 1000.0;
+
+	const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+	double *results[] = { &summary.p50Us, &summary.p90Us, &summary.p99Us, &summary.p999Us };
+	int next = 0;
+	uint64_t seen = 0;
+	for(uint32_t bucket = 0; bucket < MPT_HISTOGRAM_BUCKETS && next < 4; bucket++)
+	{
+		seen += m_Counts[bucket].load(std::memory_order_relaxed);
+		while(next < 4 && (double)seen >= percentiles[next] / 100.0 * (double)summary.count)
+		{
+			const uint64_t upperBound = bucketUpperBound(bucket);
+			*results[next++] = (double)(upperBound < maxNs ? upperBound : maxNs) / 1000.0;
+		}
+	}
+	while(next < 4) *results[next++] = summary.maxUs;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Device & panel timing
+ *
+ ******************************************************************************/
+
+void MPTResetDeviceTiming(MPTDeviceTiming &timing)
+{
+	timing.requestToHeader.reset();
+	timing.headerToLastChannel.reset();
+	timing.total.reset();
+	timing.callbackJitter.reset();
+	timing.blocks.store(0, std::memory_order_relaxed);
+	timing.timeouts.store(0, std::memory_order_relaxed);
+	timing.earlyReturns.store(0, std::memory_order_relaxed);
+	timing.spinHits.store(0, std::memory_order_relaxed);
+	timing.kernelWaits.store(0, std::memory_order_relaxed);
+	timing.offlineBlocks.store(0, std::memory_order_relaxed);
+	timing.eventsMerged.store(0, std::memory_order_relaxed);
+	timing.eventsDropped.store(0, std::memory_order_relaxed);
+	timing.quantumCallbacks.store(0, std::memory_order_relaxed);
+}
+
+void MPTResetPanelTiming(MPTPanelTiming &timing)
+{
+	timing.render.reset();
+	timing.upload.reset();
+	timing.total.reset();
+	timing.blocks.store(0, std::memory_order_relaxed);
+	timing.timeouts.store(0, std::memory_order_relaxed);
+	timing.droppedBlocks.store(0, std::memory_order_relaxed);
+	timing.failedBlocks.store(0, std::memory_order_relaxed);
+	timing.spinHits.store(0, std::memory_order_relaxed);
+	timing.kernelWaits.store(0, std::memory_order_relaxed);
+}
+
+
+void MPTSummarizeDeviceTiming(const MPTDeviceTiming &timing, MPTDeviceTimingStats &stats)
+{
+	timing.requestToHeader.summarize(stats.requestToHeader);
+	timing.headerToLastChannel.summarize(stats.headerToLastChannel);
+	timing.total.summarize(stats.total);
+	timing.callbackJitter.summarize(stats.callbackJitter);
+	stats.blocks = timing.blocks.load(std::memory_order_relaxed);
+	stats.timeouts = timing.timeouts.load(std::memory_order_relaxed);
+	stats.earlyReturns = timing.earlyReturns.load(std::memory_order_relaxed);
+	stats.spinHits = timing.spinHits.load(std::memory_order_relaxed);
+	stats.kernelWaits = timing.kernelWaits.load(std::memory_order_relaxed);
+	stats.offlineBlocks = timing.offlineBlocks.load(std::memory_order_relaxed);
+	stats.eventsMerged = timing.eventsMerged.load(std::memory_order_relaxed);
+	stats.eventsDropped = timing.eventsDropped.load(std::memory_order_relaxed);
+	stats.quantumCallbacks = timing.quantumCallbacks.load(std::memory_order_relaxed);
+}
+
+void MPTSummarizePanelTiming(const MPTPanelTiming &timing, MPTPanelTimingStats &stats)
+{
+	timing.render.summarize(stats.render);
+	timing.upload.summarize(stats.upload);
+	timing.total.summarize(stats.total);
+	stats.blocks = timing.blocks.load(std::memory_order_relaxed);
+	stats.timeouts = timing.timeouts.load(std::memory_order_relaxed);
+	stats.droppedBlocks = timing.droppedBlocks.load(std::memory_order_relaxed);
+	stats.failedBlocks = timing.failedBlocks.load(std::memory_order_relaxed);
+	stats.spinHits = timing.spinHits.load(std::memory_order_relaxed);
+	stats.kernelWaits = timing.kernelWaits.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Timing instrumentation for the real-time path, compiled into every build.
+// Histograms are HDR-style: every power of two is split into 16 linear sub-buckets, so a recorded value is
+// known to within 6.25%, from 1 ns up to about 18 minutes. Recording is a handful of relaxed stores.
+// Every histogram and counter has a single writer; anyone may read them at any time, also from the other process.
+
+#define MPT_HISTOGRAM_SUB_BUCKET_BITS 4
+#define MPT_HISTOGRAM_MAX_BITS        40
+#define MPT_HISTOGRAM_BUCKETS         ((MPT_HISTOGRAM_MAX_BITS - MPT_HISTOGRAM_SUB_BUCKET_BITS + 1) << MPT_HISTOGRAM_SUB_BUCKET_BITS)
+
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Statistics must be lock-free to be shared across processes");
+
+inline uint64_t MPTNowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Only for counters with a single writer, which spares us the locked read-modify-write
+inline void MPTAddToCounter(std::atomic<uint64_t> &counter, uint64_t amount)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline void MPTIncrementCounter(std::atomic<uint64_t> &counter)
+{
+	MPTAddToCounter(counter, 1);
+}
+
+
+typedef struct
+{
+	uint64_t count;
+	double meanUs;
+	double p50Us;
+	double p90Us;
+	double p99Us;
+	double p999Us;
+	double maxUs;
+} MPTLatencySummary;
+
+
+class MPTLatencyHistogram
+{
+private:
+	std::atomic<uint64_t> m_Counts[MPT_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> m_Count;
+	std::atomic<uint64_t> m_SumNs;
+	std::atomic<uint64_t> m_MaxNs;
+
+	static uint32_t bucketOf(uint64_t ns);
+	static uint64_t bucketUpperBound(uint32_t bucket);
+
+public:
+	void reset();                  // not thread-safe, only while nobody records
+	void record(uint64_t ns);      // single writer
+	void summarize(MPTLatencySummary &summary) const;
+};
+
+
+// Written by the device, lives in the shared region so that the panel can read it
+typedef struct
+{
+	MPTLatencyHistogram requestToHeader;      // request sent until the panel's header or ring slot was there
+	MPTLatencyHistogram headerToLastChannel;  // header until the last channel was uploaded to the mixer
+	MPTLatencyHistogram total;                // whole RWDEFDriveAudio call, including failed ones
+	MPTLatencyHistogram callbackJitter;       // deviation of the mixer's callback interval from the block duration
+	std::atomic<uint64_t> blocks;             // blocks we requested from the panel
+	std::atomic<uint64_t> timeouts;           // waits for the panel that ran into the timeout
+	std::atomic<uint64_t> earlyReturns;       // requested blocks that were not uploaded completely
+	std::atomic<uint64_t> spinHits;           // waits for the panel that were over while spinning
+	std::atomic<uint64_t> kernelWaits;        // waits for the panel that had to sleep in the kernel
+	std::atomic<uint64_t> offlineBlocks;      // blocks requested in throughput mode, see MPT_CAP_OFFLINE
+	std::atomic<uint64_t> eventsMerged;       // events to the mixer left out because a later one in the same block overrides them
+	std::atomic<uint64_t> eventsDropped;      // events that found no room in the pending queue or the mixer's event buffer
+	std::atomic<uint64_t> quantumCallbacks;   // mixer callbacks served from the render quantum without asking the panel
+} MPTDeviceTiming;
+
+// Written by the panel's audio thread
+typedef struct
+{
+	MPTLatencyHistogram render;               // render callback
+	MPTLatencyHistogram upload;               // end of rendering until the block was handed over
+	MPTLatencyHistogram total;                // request read until the block was handed over
+	std::atomic<uint64_t> blocks;
+	std::atomic<uint64_t> timeouts;           // acknowledgements from the device that never came
+	std::atomic<uint64_t> droppedBlocks;      // requests we could not serve at all
+	std::atomic<uint64_t> failedBlocks;       // blocks the pipe did not take in full
+	std::atomic<uint64_t> spinHits;           // waits for the device that were over while spinning
+	std::atomic<uint64_t> kernelWaits;        // waits for the device that had to sleep in the kernel
+} MPTPanelTiming;
+
+void MPTResetDeviceTiming(MPTDeviceTiming &timing);
+void MPTResetPanelTiming(MPTPanelTiming &timing);
+
+
+typedef struct
+{
+	MPTLatencySummary requestToHeader;
+	MPTLatencySummary headerToLastChannel;
+	MPTLatencySummary total;
+	MPTLatencySummary callbackJitter;
+	uint64_t blocks;
+	uint64_t timeouts;
+	uint64_t earlyReturns;
+	uint64_t spinHits;
+	uint64_t kernelWaits;
+	uint64_t offlineBlocks;
+	uint64_t eventsMerged;
+	uint64_t eventsDropped;
+	uint64_t quantumCallbacks;
+} MPTDeviceTimingStats;
+
+typedef struct
+{
+	MPTLatencySummary render;
+	MPTLatencySummary upload;
+	MPTLatencySummary total;
+	uint64_t blocks;
+	uint64_t timeouts;
+	uint64_t droppedBlocks;
+	uint64_t failedBlocks;
+	uint64_t spinHits;
+	uint64_t kernelWaits;
+} MPTPanelTimingStats;
+
+void MPTSummarizeDeviceTiming(const MPTDeviceTiming &timing, MPTDeviceTimingStats &stats);
+void MPTSummarizePanelTiming(const MPTPanelTiming &timing, MPTPanelTimingStats &stats);
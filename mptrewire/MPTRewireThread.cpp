@@ -0,0 +1,129 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <avrt.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "avrt.lib")
+#endif
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+#include "MPTRewireThread.h"
+
+
+
+/*******************************************************************************
+ *
+ * Windows
+ *
+ ******************************************************************************/
+
+#ifdef _WIN32
+
+MPTSchedulingClass MPTEnterRealTime(const MPTThreadOptions &options, void **revertToken)
+{
+	*revertToken = nullptr;
+	if(!options.realTime) return MPTSchedulingClass::Normal;
+
+	DWORD taskIndex = 0;
+	HANDLE task = AvSetMmThreadCharacteristicsA("Pro Audio", &taskIndex);
+	if(task)
+	{
+		AvSetMmThreadPriority(task, AVRT_PRIORITY_HIGH);
+		*revertToken = task;
+		return MPTSchedulingClass::Mmcss;
+	}
+
+	// The MMCSS service may be disabled, a plain priority boost is better than nothing
+	if(SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+		return MPTSchedulingClass::TimeCritical;
+	return MPTSchedulingClass::Normal;
+}
+
+void MPTLeaveRealTime(void *revertToken)
+{
+	if(revertToken) AvRevertMmThreadCharacteristics(revertToken);
+}
+
+bool MPTSetThreadAffinity(uint64_t affinityMask)
+{
+	if(!affinityMask) return false;
+	return 0 != SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)affinityMask);
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * POSIX
+ *
+ ******************************************************************************/
+
+#else
+
+MPTSchedulingClass MPTEnterRealTime(const MPTThreadOptions &options, void **revertToken)
+{
+	*revertToken = nullptr;
+	if(!options.realTime) return MPTSchedulingClass::Normal;
+
+	const int policy = options.roundRobin ? SCHED_RR : SCHED_FIFO;
+	const int minPriority = sched_get_priority_min(policy);
+	const int maxPriority = sched_get_priority_max(policy);
+	struct sched_param param;
+	param.sched_priority = MPT_AUDIO_THREAD_PRIORITY;
+	if(param.sched_priority > maxPriority) param.sched_priority = maxPriority;
+	if(param.sched_priority < minPriority) param.sched_priority = minPriority;
+
+	int error = pthread_setschedparam(pthread_self(), policy, &param);
+	if(EPERM == error)
+	{
+		// Without CAP_SYS_NICE we may still go as high as RLIMIT_RTPRIO, e.g. when in the audio group
+		struct rlimit limit;
+		if(0 == getrlimit(RLIMIT_RTPRIO, &limit) && limit.rlim_cur >= (rlim_t)minPriority && limit.rlim_cur < (rlim_t)param.sched_priority)
+		{
+			param.sched_priority = (int)limit.rlim_cur;
+			error = pthread_setschedparam(pthread_self(), policy, &param);
+		}
+	}
+	if(error) return MPTSchedulingClass::Normal;
+	return options.roundRobin ? MPTSchedulingClass::RoundRobin : MPTSchedulingClass::Fifo;
+}
+
+void MPTLeaveRealTime(void *)
+{
+	// The scheduling class ends with the thread
+}
+
+bool MPTSetThreadAffinity(uint64_t affinityMask)
+{
+	if(!affinityMask) return false;
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	for(int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++)
+	{
+		if(affinityMask & ((uint64_t)1 << cpu)) CPU_SET(cpu, &cpus);
+	}
+	return 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+#endif
+
+
+
+
+const char *MPTSchedulingClassName(MPTSchedulingClass schedulingClass)
+{
+	switch(schedulingClass)
+	{
+		case MPTSchedulingClass::TimeCritical: return "time critical";
+		case MPTSchedulingClass::Mmcss: return "MMCSS Pro Audio";
+		case MPTSchedulingClass::Fifo: return "SCHED_FIFO";
+		case MPTSchedulingClass::RoundRobin: return "SCHED_RR";
+		default: return "normal";
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// Scheduling of the panel's audio thread, so that rendering does not have to compete with the GUI.
+// Windows registers the thread with MMCSS as "Pro Audio", elsewhere it asks for SCHED_FIFO or SCHED_RR.
+// Nothing here needs privileges to succeed; whatever we got is reported back.
+
+#define MPT_AUDIO_THREAD_PRIORITY 70  // POSIX real-time priority, clamped to what the system allows us
+
+
+enum class MPTSchedulingClass
+{
+	Normal = 0,        // not requested, or every attempt failed
+	TimeCritical = 1,  // Windows without MMCSS: THREAD_PRIORITY_TIME_CRITICAL
+	Mmcss = 2,         // Windows: MMCSS "Pro Audio"
+	Fifo = 3,          // POSIX: SCHED_FIFO
+	RoundRobin = 4,    // POSIX: SCHED_RR
+};
+
+typedef struct
+{
+	bool realTime = false;
+	bool roundRobin = false;    // SCHED_RR instead of SCHED_FIFO, POSIX only
+	uint64_t affinityMask = 0;  // CPUs the thread may run on, one bit each; 0 leaves the affinity alone
+} MPTThreadOptions;
+
+
+// Both act on the calling thread. *revertToken must be handed to MPTLeaveRealTime() before the thread exits.
+MPTSchedulingClass MPTEnterRealTime(const MPTThreadOptions &options, void **revertToken);
+void MPTLeaveRealTime(void *revertToken);
+bool MPTSetThreadAffinity(uint64_t affinityMask);
+
+const char *MPTSchedulingClassName(MPTSchedulingClass schedulingClass);
@@ -0,0 +1,264 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MPT_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define MPT_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define MPT_CPU_RELAX() ((void)0)
+#endif
+#include <thread>
+#include "MPTRewireWait.h"
+#include "MPTRewireStats.h"
+
+
+#define MPT_SPINS_PER_CLOCK_READ 64
+
+
+
+/*******************************************************************************
+ *
+ * Kernel backend
+ *
+ ******************************************************************************/
+
+#ifdef _WIN32
+bool MPTSetNamedEvent(void *event)
+{
+	return FALSE != SetEvent(event);
+}
+
+MPTWaitResult MPTWaitForNamedEvent(void *event, uint32_t milliseconds)
+{
+	switch(WaitForSingleObject(event, milliseconds))
+	{
+		case WAIT_ABANDONED:
+		case WAIT_OBJECT_0:
+			return MPTWaitResult::Woken;
+		case WAIT_TIMEOUT:
+			return MPTWaitResult::Timeout;
+	}
+	return MPTWaitResult::Failed;
+}
+#else
+// Not FUTEX_PRIVATE_FLAG: the word is shared with the other process
+static void SleepOnWord(std::atomic<uint32_t> &word, uint32_t expected, uint64_t timeoutNs)
+{
+	struct timespec timeout;
+	timeout.tv_sec = (time_t)(timeoutNs / 1000000000);
+	timeout.tv_nsec = (long)(timeoutNs % 1000000000);
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+static void WakeWord(std::atomic<uint32_t> &word)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+#endif
+
+
+#ifdef _WIN32
+void MPTSleepOnLocalWord(std::atomic<uint32_t> &word, uint32_t expected, uint32_t milliseconds)
+{
+	WaitOnAddress(reinterpret_cast<volatile VOID *>(&word), &expected, sizeof(expected), milliseconds);
+}
+
+void MPTWakeLocalWord(std::atomic<uint32_t> &word, bool all)
+{
+	if(all)
+		WakeByAddressAll(reinterpret_cast<PVOID>(&word));
+	else
+		WakeByAddressSingle(reinterpret_cast<PVOID>(&word));
+}
+#else
+void MPTSleepOnLocalWord(std::atomic<uint32_t> &word, uint32_t expected, uint32_t milliseconds)
+{
+	struct timespec timeout;
+	timeout.tv_sec = (time_t)(milliseconds / 1000);
+	timeout.tv_nsec = (long)(milliseconds % 1000) * 1000000;
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+}
+
+void MPTWakeLocalWord(std::atomic<uint32_t> &word, bool all)
+{
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+}
+#endif
+
+
+
+
+/*******************************************************************************
+ *
+ * Spin budget
+ *
+ ******************************************************************************/
+
+void MPTHybridEvent::setBlockDuration(uint32_t framesToRender, uint32_t sampleRate)
+{
+	if(framesToRender == m_Frames && sampleRate == m_SampleRate) return;
+	m_Frames = framesToRender;
+	m_SampleRate = sampleRate;
+
+	// Spinning on a single core only keeps the other side from running
+	m_SpinBudgetNs = 0;
+	if(m_SpinEnabled && sampleRate && std::thread::hardware_concurrency() > 1)
+	{
+		m_SpinBudgetNs = (uint64_t)framesToRender * 1000000000 / sampleRate / MPT_SPIN_BLOCK_DIVISOR;
+		if(m_SpinBudgetNs > MPT_SPIN_MAX_NS) m_SpinBudgetNs = MPT_SPIN_MAX_NS;
+	}
+	m_SpinNs = m_SpinBudgetNs;
+}
+
+void MPTHybridEvent::enableSpinning(bool enable)
+{
+	m_SpinEnabled = enable;
+	m_Frames = m_SampleRate = 0;  // recalculated on the next setBlockDuration()
+	m_SpinBudgetNs = m_SpinNs = 0;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Signalling & waiting
+ *
+ ******************************************************************************/
+
+void MPTHybridEvent::set()
+{
+	if(!m_Signal)
+	{
+		MPTSetNamedEvent(m_Event);
+		return;
+	}
+
+	// Release: everything we wrote before is visible to the waiter once it sees the signal
+	if(MPT_SIGNAL_SLEEPING == m_Signal->state.exchange(MPT_SIGNAL_SET, std::memory_order_acq_rel))
+	{
+#ifdef _WIN32
+		MPTSetNamedEvent(m_Event);
+#else
+		WakeWord(m_Signal->state);
+#endif
+	}
+}
+
+
+bool MPTHybridEvent::consume()
+{
+	uint32_t expected = MPT_SIGNAL_SET;
+	return m_Signal->state.compare_exchange_strong(expected, MPT_SIGNAL_EMPTY, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+
+MPTWaitResult MPTHybridEvent::waitForEvent(uint32_t milliseconds)
+{
+	return MPTWaitForNamedEvent(m_Event, milliseconds);
+}
+
+
+MPTWaitResult MPTHybridEvent::wait(uint32_t milliseconds)
+{
+	if(!m_Signal) return waitForEvent(milliseconds);
+	if(consume()) return MPTWaitResult::Spun;
+
+	const uint64_t startNs = MPTNowNs();
+	if(m_SpinNs)
+	{
+		do
+		{
+			// Reading the clock costs more than a pause, so only do it every couple of rounds
+			for(int i = 0; i < MPT_SPINS_PER_CLOCK_READ; i++)
+			{
+				MPT_CPU_RELAX();
+				if(MPT_SIGNAL_SET == m_Signal->state.load(std::memory_order_relaxed) && consume())
+					return MPTWaitResult::Spun;
+			}
+		} while(MPTNowNs() - startNs < m_SpinNs);
+	}
+
+	const MPTWaitResult result = sleepUntilSet(startNs, milliseconds);
+
+	// Spin longer if the signal came in soon after we gave up, shorter if it was a long way off anyway
+	if(MPTWaitResult::Woken == result && MPTNowNs() - startNs <= m_SpinBudgetNs)
+		m_SpinNs = (2 * m_SpinNs < m_SpinBudgetNs) ? 2 * m_SpinNs : m_SpinBudgetNs;
+	else
+		m_SpinNs = (m_SpinNs / 2 > m_SpinBudgetNs / 8) ? m_SpinNs / 2 : m_SpinBudgetNs / 8;
+	return result;
+}
+
+
+bool MPTSpinWhileEqual(const std::atomic<uint32_t> &word, uint32_t value, uint64_t spinNs)
+{
+	if(value != word.load(std::memory_order_acquire)) return true;
+	if(!spinNs) return false;
+
+	const uint64_t startNs = MPTNowNs();
+	do
+	{
+		for(int i = 0; i < MPT_SPINS_PER_CLOCK_READ; i++)
+		{
+			MPT_CPU_RELAX();
+			if(value != word.load(std::memory_order_acquire)) return true;
+		}
+	} while(MPTNowNs() - startNs < spinNs);
+	return false;
+}
+
+
+MPTWaitResult MPTHybridEvent::sleepUntilSet(uint64_t startNs, uint32_t milliseconds)
+{
+	// Announce that we are going to sleep; from here on the signaller makes the system call to wake us
+	uint32_t expected = MPT_SIGNAL_EMPTY;
+	if(!m_Signal->state.compare_exchange_strong(expected, MPT_SIGNAL_SLEEPING, std::memory_order_acq_rel, std::memory_order_acquire))
+	{
+		consume();  // it came in just now
+		return MPTWaitResult::Spun;
+	}
+
+	const uint64_t deadlineNs = startNs + (uint64_t)milliseconds * 1000000;
+	for(uint64_t nowNs = MPTNowNs(); nowNs < deadlineNs; nowNs = MPTNowNs())
+	{
+#ifdef _WIN32
+		const uint32_t remainingMs = (uint32_t)((deadlineNs - nowNs + 999999) / 1000000);
+		const MPTWaitResult result = waitForEvent(remainingMs);
+		if(MPTWaitResult::Woken == result)
+		{
+			// Set by a signaller that saw us sleeping, or by one that does not use the shared word (yet)
+			m_Signal->state.exchange(MPT_SIGNAL_EMPTY, std::memory_order_acquire);
+			return result;
+		}
+		if(MPTWaitResult::Failed == result)
+		{
+			m_Signal->state.store(MPT_SIGNAL_EMPTY, std::memory_order_relaxed);
+			return result;
+		}
+#else
+		SleepOnWord(m_Signal->state, MPT_SIGNAL_SLEEPING, deadlineNs - nowNs);
+		if(consume()) return MPTWaitResult::Woken;
+#endif
+	}
+
+	// Withdraw the announcement, unless the signal raced the timeout
+	expected = MPT_SIGNAL_SLEEPING;
+	if(m_Signal->state.compare_exchange_strong(expected, MPT_SIGNAL_EMPTY, std::memory_order_acquire, std::memory_order_relaxed))
+		return MPTWaitResult::Timeout;
+#ifdef _WIN32
+	// The signaller saw us sleeping and sets the event, which must not wake up our next wait instead
+	waitForEvent(milliseconds);
+#endif
+	consume();
+	return MPTWaitResult::Woken;
+}
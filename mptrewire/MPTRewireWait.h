@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+// Spin-then-block wakeups between panel and device.
+// Most handshakes are answered within microseconds, far quicker than a kernel sleep and wakeup takes.
+// The waiter therefore spins on a word in the shared region for a while and only then goes to sleep in the
+// kernel: on a futex on that same word on Linux, on the named event on Windows. The signaller only makes a
+// system call when the waiter announced that it sleeps.
+// Without a shared word, e.g. when the region could not be mapped, this is a plain wait on the named event.
+
+#define MPT_SIGNAL_EMPTY    0
+#define MPT_SIGNAL_SET      1
+#define MPT_SIGNAL_SLEEPING 2  // the waiter is asleep in the kernel, or about to be, and needs a wakeup
+
+#define MPT_SPIN_MAX_NS       100000  // spin at most this long, however long the blocks are
+#define MPT_SPIN_BLOCK_DIVISOR 16     // and at most this fraction of a block
+
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Signals must be lock-free to be shared across processes");
+
+// Lives in the shared region, one per direction
+typedef struct
+{
+	std::atomic<uint32_t> state;  // MPT_SIGNAL_*
+} MPTSharedSignal;
+
+
+enum class MPTWaitResult
+{
+	Spun = 0,     // signaled while spinning, no system call was made
+	Woken = 1,    // signaled after going to sleep in the kernel
+	Timeout = 2,
+	Failed = 3,
+};
+
+
+// The named events panel and device share, to sleep on when there is no shared word. Defined in MPTRewireWait.cpp
+// on Windows; elsewhere by whatever provides the named events, e.g. bench/mock.
+bool MPTSetNamedEvent(void *event);
+MPTWaitResult MPTWaitForNamedEvent(void *event, uint32_t milliseconds);
+
+// The same for threads of one process, e.g. the render pool, without any shared region or named event.
+// Spins until word no longer holds value or spinNs passed, returns whether it changed.
+bool MPTSpinWhileEqual(const std::atomic<uint32_t> &word, uint32_t value, uint64_t spinNs);
+// Sleeps in the kernel while word holds expected, at most milliseconds; may also return early for no reason
+void MPTSleepOnLocalWord(std::atomic<uint32_t> &word, uint32_t expected, uint32_t milliseconds);
+// Wakes one or every thread sleeping on word. A system call, so only make it when someone announced that it sleeps.
+void MPTWakeLocalWord(std::atomic<uint32_t> &word, bool all);
+
+
+/**
+ * An auto-reset event with a single waiter and a single signaller. Both sides have to agree on whether
+ * they use the shared word; see MPTSharedControlHeader::panelUsesSignals.
+**/
+class MPTHybridEvent
+{
+private:
+	void *m_Event = nullptr;              // named event, the kernel object we sleep on without a futex
+	MPTSharedSignal *m_Signal = nullptr;  // nullptr: plain event
+	uint32_t m_Frames = 0;                // block the spin budget was derived from
+	uint32_t m_SampleRate = 0;
+	uint64_t m_SpinBudgetNs = 0;          // upper limit for spinning
+	uint64_t m_SpinNs = 0;                // how long we currently spin, adapts to how often that pays off
+	bool m_SpinEnabled = true;
+
+	bool consume();
+	MPTWaitResult waitForEvent(uint32_t milliseconds);
+	MPTWaitResult sleepUntilSet(uint64_t startNs, uint32_t milliseconds);
+
+public:
+	void setEvent(void *eventHandle) { m_Event = eventHandle; }
+	void setSignal(MPTSharedSignal *signal) { m_Signal = signal; }
+	bool isUsingSignal() const { return nullptr != m_Signal; }
+	void setBlockDuration(uint32_t framesToRender, uint32_t sampleRate);
+	void enableSpinning(bool enable);
+
+	void set();
+	MPTWaitResult wait(uint32_t milliseconds);
+};
@@ -0,0 +1,537 @@
+#include <Windows.h>
+#include <RWDEFAPI.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <new>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "MPTRewireAudioKernels.h"
+#include "MPTRewirePanel.h"
+
+// Loopback benchmark: drives RWDEFDriveAudio like a mixer would, with the panel rendering on its own
+// thread in the same process, and reports how long each block took from request to fully uploaded.
+// It also checks that the mixer got the samples the panel rendered.
+
+using namespace ReWire;
+
+
+typedef struct
+{
+	int sampleRate = 44100;
+	int framesToRender = 512;
+	int maxBufferSize = 0;   // defaults to framesToRender
+	int channels = 16;       // stereo channels the panel serves
+	int blocks = 20000;
+	int warmupBlocks = 200;
+	bool sharedMemory = false;
+	bool float32 = false;
+	int packedBits = 0;      // 24 or 16 for a packed payload on the pipe, 0 for none
+	int renderAhead = 0;
+	int renderQuantum = 0;   // frames
+	bool realTime = false;   // pace blocks like a sound card instead of driving them back to back
+	int burst = 1;           // with realTime: blocks delivered back to back per pause, like a mixer that splits its buffer
+	bool spinWait = true;
+	bool offlineDetection = true;  // back to back blocks look like a bounce to the device
+	bool realTimeThread = false;
+	bool roundRobin = false;
+	uint64_t affinityMask = 0;
+	int renderWorkers = -1;  // -1: render every channel in the render callback
+	uint64_t workerAffinityMask = 0;
+	int channelsPerGroup = 4;
+	int tempoChanges = 0;    // per block, like a tempo slide; every 100th block also restarts the song
+	int resizeEvery = 0;     // blocks between max buffer size changes, 0 for none
+	int buses = 0;           // ReWire channels the served channels are summed into by a routing map, 0 for one each
+} BenchOptions;
+
+typedef struct
+{
+	const BenchOptions *options;
+	MPTRewirePanel *panel;
+	uint32_t blockIndex;
+	uint32_t blockPosition;   // frames rendered before the current block
+	uint32_t nextBlockPosition;
+	int32_t lastTransportPosition;
+	uint32_t transportJumps;  // blocks whose mixer position did not follow on from the previous one
+} BenchRenderContext;
+
+
+
+/*******************************************************************************
+ *
+ * Heap allocations
+ *
+ ******************************************************************************/
+
+// Counts what the threads with real-time duties allocate once the measurement runs: the panel thread and the
+// render workers as soon as they render, the mixer thread while it is inside RWDEFDriveAudio.
+static std::atomic<bool> g_CountAllocations{false};
+static std::atomic<uint64_t> g_RealTimeAllocations{0};
+static thread_local bool t_RealTimeThread = false;
+
+static void *CountedAlloc(size_t size, size_t alignment)
+{
+	if(t_RealTimeThread && g_CountAllocations.load(std::memory_order_relaxed))
+		g_RealTimeAllocations.fetch_add(1, std::memory_order_relaxed);
+	if(0 == size) size = 1;
+	void *p = (alignment > alignof(max_align_t)) ? aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1)) : malloc(size);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t size) { return CountedAlloc(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) { return CountedAlloc(size, (size_t)alignment); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+
+
+
+
+/*******************************************************************************
+ *
+ * Panel side
+ *
+ ******************************************************************************/
+
+// Every channel plays a saw tooth of its own, rising on the left and falling on the right, so that the mixer can tell
+// which frames of which channels it got. The steps are coarse enough for 16 bit, and any sum of channels is exact.
+#define PATTERN_PERIOD     64                  // frames
+#define PATTERN_STEP       (1.0f / 8192.0f)
+#define PATTERN_STEP_INT32 (1 << (27 - 13))    // PATTERN_STEP with OpenMPT's 27 fractional bits
+
+static int PatternSteps(int channel, uint32_t position, bool right)
+{
+	return (int)((position + 5 * channel + (right ? 17 : 0)) & (PATTERN_PERIOD - 1)) + 1;
+}
+
+// Stands in for OpenMPT's mixer
+static void RenderChannel(BenchRenderContext *context, int channel, unsigned int framesToRender)
+{
+	MPTRewirePanel *panel = context->panel;
+	if(MPTSampleFormat::Float32 == panel->m_SampleFormat)
+	{
+		float *p = panel->getFloatAudioBuffer(channel);
+		for(unsigned int s = 0; s < framesToRender; s++)
+		{
+			*p++ = (float)PatternSteps(channel, context->blockPosition + s, false) * PATTERN_STEP;
+			*p++ = -(float)PatternSteps(channel, context->blockPosition + s, true) * PATTERN_STEP;
+		}
+	} else
+	{
+		int *p = panel->m_AudioBuffers[channel];
+		for(unsigned int s = 0; s < framesToRender; s++)
+		{
+			*p++ = PatternSteps(channel, context->blockPosition + s, false) * PATTERN_STEP_INT32;
+			*p++ = -PatternSteps(channel, context->blockPosition + s, true) * PATTERN_STEP_INT32;
+		}
+	}
+}
+
+// Sends what OpenMPT would send during a tempo slide, and what it sends when the song is restarted elsewhere
+static void SignalEvents(BenchRenderContext *context, unsigned int framesToRender)
+{
+	const BenchOptions *options = context->options;
+	for(int i = 0; i < options->tempoChanges; i++)
+		context->panel->signalBPMChange(120.0 + (context->blockIndex + i) % 16, framesToRender * i / options->tempoChanges);
+	if(options->tempoChanges && 0 == context->blockIndex % 100)
+	{
+		context->panel->signalStop();
+		context->panel->signalRepositionToPPQ(0);
+		context->panel->signalPlay(120.0);
+	}
+}
+
+// Renders the first options->channels channels, unless the render pool does that
+static bool RenderCallback(unsigned int framesToRender, void *userData)
+{
+	BenchRenderContext *context = static_cast<BenchRenderContext *>(userData);
+	t_RealTimeThread = true;
+	context->blockIndex++;
+	context->blockPosition = context->nextBlockPosition;
+	context->nextBlockPosition += framesToRender;
+	SignalEvents(context, framesToRender);
+
+	// The bench mixer plays at 120 BPM and ignores our events, so the position must advance by one block every time
+	const MPTTransportState &transport = context->panel->getMixerTransport();
+	const int32_t blockTicks = (int32_t)(2.0 * 15360.0 * framesToRender / context->panel->m_SampleRate);
+	const int32_t advance = transport.ppq15360Position - context->lastTransportPosition;
+	if(context->blockIndex > 1 && (advance < blockTicks - 2 || advance > blockTicks + 2)) context->transportJumps++;
+	context->lastTransportPosition = transport.ppq15360Position;
+	if(context->options->renderWorkers >= 0) return true;
+
+	for(int channel = 0; channel < context->options->channels; channel++)
+	{
+		RenderChannel(context, channel, framesToRender);
+		context->panel->markChannelAsRendered(channel);
+	}
+	return true;
+}
+
+static uint32_t RenderChannelGroupCallback(unsigned int framesToRender, int firstChannel, int channelCount, void *userData)
+{
+	BenchRenderContext *context = static_cast<BenchRenderContext *>(userData);
+	t_RealTimeThread = true;
+	uint32_t rendered = 0;
+	for(int i = 0; i < channelCount && firstChannel + i < context->options->channels; i++)
+	{
+		RenderChannel(context, firstChannel + i, framesToRender);
+		rendered |= 1u << i;
+	}
+	return rendered;
+}
+
+static void AudioInfoCallback(unsigned int, unsigned int, void *) {}
+static void MixerQuitCallback(void *) { fprintf(stderr, "Mixer quit unexpectedly.\n"); }
+
+
+
+
+/*******************************************************************************
+ *
+ * Mixer side
+ *
+ ******************************************************************************/
+
+static int CountServedChannels(const ReWireDriveAudioOutputParams &outputParams)
+{
+	int served = 0;
+	for(int channel = 0; channel < kReWireAudioChannelCount / 2; channel++)
+	{
+		if(ReWireIsBitInBitFieldSet(outputParams.fServedChannelsBitField, 2 * channel))
+			served++;
+	}
+	return served;
+}
+
+// The channels summed into every bus, as WriteRoutingMap() routes them
+static std::vector<std::vector<int>> BusSources(const BenchOptions &options)
+{
+	std::vector<std::vector<int>> busSources(kReWireAudioChannelCount / 2);
+	for(int channel = 0; channel < options.channels; channel++)
+		busSources[options.buses ? channel % options.buses : channel].push_back(channel);
+	return busSources;
+}
+
+static int ExpectedSteps(const std::vector<int> &sources, uint32_t position, bool right)
+{
+	int steps = 0;
+	for(int source : sources) steps += PatternSteps(source, position, right);
+	return steps;
+}
+
+// The block may start anywhere in the pattern, render-ahead and the render quantum shift it; but from there on
+// every frame has to follow
+static bool CheckBusSamples(const std::vector<int> &sources, const float *left, const float *right, int frames, float tolerance)
+{
+	for(uint32_t phase = 0; phase < PATTERN_PERIOD; phase++)
+	{
+		bool match = true;
+		for(int s = 0; s < frames && match; s++)
+		{
+			match = fabsf(left[s] - (float)ExpectedSteps(sources, phase + s, false) * PATTERN_STEP) <= tolerance
+				&& fabsf(right[s] + (float)ExpectedSteps(sources, phase + s, true) * PATTERN_STEP) <= tolerance;
+		}
+		if(match) return true;
+	}
+	return false;
+}
+
+static double Percentile(const std::vector<double> &sorted, double percentile)
+{
+	if(sorted.empty()) return 0.0;
+	size_t index = (size_t)(percentile / 100.0 * (double)(sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+
+// The device reads it when it is opened, from next to where the mock runtime places our executable
+static bool WriteRoutingMap(const BenchOptions &options)
+{
+	MPTRoutingMap routing;
+	memset(&routing, 0, sizeof(routing));
+	memset(routing.sourceBus, MPT_ROUTING_UNROUTED, sizeof(routing.sourceBus));
+	routing.busCount = (uint32_t)options.buses;
+	for(int bus = 0; bus < options.buses; bus++)
+		snprintf(routing.busNames[bus], MPT_ROUTING_NAME_SIZE, "Bus %i", bus + 1);
+	for(int channel = 0; channel < options.channels; channel++)
+		routing.sourceBus[channel] = (uint8_t)(channel % options.buses);
+	return MPTRewirePanel::saveRoutingMap(routing);
+}
+
+
+static int RunBenchmark(const BenchOptions &options)
+{
+	const int maxBufferSize = options.maxBufferSize ? options.maxBufferSize : options.framesToRender;
+	const int servedChannels = options.buses ? std::min(options.buses, options.channels) : options.channels;
+	if(options.buses && !WriteRoutingMap(options))
+	{
+		fprintf(stderr, "Writing the routing map failed.\n");
+		return 1;
+	}
+
+	ReWireOpenInfo openInfo;
+	ReWirePrepareOpenInfo(&openInfo, options.sampleRate, maxBufferSize);
+	if(kReWireError_NoError != RWDEFOpenDevice(&openInfo))
+	{
+		fprintf(stderr, "RWDEFOpenDevice failed.\n");
+		return 1;
+	}
+
+	MPTRewirePanel panel;
+	BenchRenderContext context = { &options, &panel, 0, 0, 0 };
+	panel.useSharedMemoryTransport(options.sharedMemory);
+	panel.useFloat32Format(options.float32);
+	panel.usePayloadFormat((24 == options.packedBits) ? MPTPayloadFormat::Packed24 : (16 == options.packedBits) ? MPTPayloadFormat::Packed16 : MPTPayloadFormat::Native);
+	panel.setRenderAhead((uint32_t)options.renderAhead);
+	panel.setRenderQuantum((uint32_t)options.renderQuantum);
+	panel.useSpinWait(options.spinWait);
+	panel.useOfflineDetection(options.offlineDetection);
+	panel.useRealTimeScheduling(options.realTimeThread, options.affinityMask, options.roundRobin);
+	if(options.renderWorkers >= 0) panel.useParallelRendering(RenderChannelGroupCallback, options.renderWorkers, options.channelsPerGroup, options.workerAffinityMask);
+	if(MPTPanelStatus::Ok != panel.open(RenderCallback, AudioInfoCallback, MixerQuitCallback, &context))
+	{
+		fprintf(stderr, "Opening the panel failed.\n");
+		RWDEFCloseDevice();
+		return 1;
+	}
+	RWDEFIdle();  // like a mixer's idle thread would before the first block
+
+	// Mixer buffers, one planar float buffer per mono channel
+	std::vector<float> mixerMemory((size_t)kReWireAudioChannelCount * maxBufferSize);
+	std::vector<float *> mixerBuffers(kReWireAudioChannelCount);
+	for(int i = 0; i < kReWireAudioChannelCount; i++)
+		mixerBuffers[i] = &mixerMemory[(size_t)i * maxBufferSize];
+	std::vector<ReWireEvent> eventsOut(512);
+
+	ReWireDriveAudioInputParams inputParams;
+	memset(&inputParams, 0, sizeof(inputParams));
+	inputParams.fAudioBuffers = mixerBuffers.data();
+	for(int i = 0; i < kReWireAudioChannelCount; i++)
+		ReWireSetBitInBitField(inputParams.fRequestedChannelsBitField, (ReWire_uint16_t)i);
+	inputParams.fFramesToRender = options.framesToRender;
+	inputParams.fTempo = 120000;
+	inputParams.fSignatureNumerator = inputParams.fSignatureDenominator = 4;
+	inputParams.fPlayMode = kReWirePlayModeNormal;
+
+	ReWireDriveAudioOutputParams outputParams;
+	std::vector<double> latencies;
+	latencies.reserve(options.blocks);
+	int incompleteBlocks = 0;
+	int corruptBlocks = 0;  // served channels that do not hold what the panel rendered
+	uint64_t mixerEvents = 0;
+	const std::vector<std::vector<int>> busSources = BusSources(options);
+	const float tolerance = (16 == options.packedBits) ? 2.0f / MPT_INT16_SCALEF : 0.0f;  // dither
+
+	const double blockSeconds = (double)options.framesToRender / options.sampleRate;
+	const auto blockDuration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(blockSeconds));
+	auto nextDeadline = std::chrono::steady_clock::now();
+	auto measureStart = nextDeadline;
+
+	for(int block = 0; block < options.warmupBlocks + options.blocks; block++)
+	{
+		if(block == options.warmupBlocks)
+		{
+			measureStart = std::chrono::steady_clock::now();
+			g_CountAllocations = true;
+		}
+
+		// The panel has to grow its buffers without allocating on its audio thread; the bigger size is only
+		// announced, the blocks keep their size
+		if(options.resizeEvery && block && 0 == block % options.resizeEvery)
+		{
+			ReWireAudioInfo audioInfo;
+			ReWirePrepareAudioInfo(&audioInfo, options.sampleRate, (block / options.resizeEvery) % 2 ? maxBufferSize + 8192 : maxBufferSize);
+			RWDEFSetAudioInfo(&audioInfo);
+		}
+
+		memset(&outputParams, 0, sizeof(outputParams));
+		outputParams.fEventOutBuffer.fEventBufferSize = (ReWire_uint32_t)eventsOut.size();
+		outputParams.fEventOutBuffer.fEventBuffer = eventsOut.data();
+
+		auto start = std::chrono::steady_clock::now();
+		t_RealTimeThread = true;
+		RWDEFDriveAudio(&inputParams, &outputParams);
+		t_RealTimeThread = false;
+		auto stop = std::chrono::steady_clock::now();
+		inputParams.fPPQ15360TickOfBatchStart += (ReWire_int32_t)(blockSeconds * 2.0 * 15360.0);  // at 120 BPM
+
+		// Warm-up is paced as well, or the device would take it for a bounce
+		if(options.realTime)
+		{
+			nextDeadline += blockDuration;
+			if(0 == (block + 1) % options.burst) std::this_thread::sleep_until(nextDeadline);
+		}
+
+		if(block < options.warmupBlocks) continue;
+		mixerEvents += outputParams.fEventOutBuffer.fCount;
+		latencies.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+		if(CountServedChannels(outputParams) != servedChannels) incompleteBlocks++;
+		for(int bus = 0; bus < kReWireAudioChannelCount / 2; bus++)
+		{
+			if(ReWireIsBitInBitFieldSet(outputParams.fServedChannelsBitField, 2 * bus)
+				&& !CheckBusSamples(busSources[bus], mixerBuffers[2 * bus], mixerBuffers[2 * bus + 1], options.framesToRender, tolerance))
+			{
+				corruptBlocks++;
+				break;
+			}
+		}
+	}
+	const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStart).count();
+	g_CountAllocations = false;
+	const uint64_t realTimeAllocations = g_RealTimeAllocations.load();
+
+	const uint32_t renderAheadLatency = panel.getRenderAheadLatency();
+	const uint32_t renderQuantumLatency = panel.getRenderQuantumLatency();
+	MPTDeviceTimingStats deviceStats;
+	MPTPanelTimingStats panelStats;
+	const bool haveDeviceStats = panel.getDeviceTimingStats(deviceStats);
+	panel.getPanelTimingStats(panelStats);
+	const MPTSchedulingClass schedulingClass = panel.getAudioThreadSchedulingClass();
+	const bool pinned = panel.isAudioThreadPinned();
+	const int renderWorkers = panel.getRenderWorkerCount();
+	MPTLockedMemoryStats memoryStats;
+	panel.getLockedMemoryStats(memoryStats);  // panel and device share the process here
+	panel.close();
+	RWDEFCloseDevice();
+	if(options.buses) remove("./" MPT_ROUTING_MAP_FILE);
+
+	std::vector<double> sorted = latencies;
+	std::sort(sorted.begin(), sorted.end());
+	const double blocksPerSecond = (double)latencies.size() / elapsedSeconds;
+
+	char format[16];
+	if(options.packedBits) snprintf(format, sizeof(format), "packed%i", options.packedBits);
+	else snprintf(format, sizeof(format), "%s", options.float32 ? "float32" : "int32");
+	printf("transport=%s format=%s render-ahead=%i spin=%s sample-rate=%i frames=%i channels=%i buses=%i blocks=%i\n",
+		options.sharedMemory ? "shm" : "pipe", format, options.renderAhead, options.spinWait ? "on" : "off",
+		options.sampleRate, options.framesToRender, options.channels, servedChannels, (int)latencies.size());
+	printf("round-trip us: p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+		Percentile(sorted, 50.0), Percentile(sorted, 90.0), Percentile(sorted, 99.0), Percentile(sorted, 99.9), sorted.empty() ? 0.0 : sorted.back());
+	printf("throughput: %.0f blocks/s (%.1fx real time), incomplete blocks: %i, render-ahead latency: %u frames\n",
+		blocksPerSecond, blocksPerSecond * blockSeconds, incompleteBlocks, renderAheadLatency);
+	printf("samples: %i blocks with channels that differ from what was rendered\n", corruptBlocks);
+	if(haveDeviceStats)
+	{
+		printf("device us: request->header p50=%.1f p99=%.1f, header->last channel p50=%.1f p99=%.1f, timeouts=%llu early-returns=%llu\n",
+			deviceStats.requestToHeader.p50Us, deviceStats.requestToHeader.p99Us,
+			deviceStats.headerToLastChannel.p50Us, deviceStats.headerToLastChannel.p99Us,
+			(unsigned long long)deviceStats.timeouts, (unsigned long long)deviceStats.earlyReturns);
+		printf("device waits: spin hits=%llu kernel=%llu, offline blocks: %llu\n", (unsigned long long)deviceStats.spinHits,
+			(unsigned long long)deviceStats.kernelWaits, (unsigned long long)deviceStats.offlineBlocks);
+		if(options.renderQuantum)
+			printf("render quantum: %i frames, %llu callbacks without a request, latency: %u frames\n", options.renderQuantum,
+				(unsigned long long)deviceStats.quantumCallbacks, renderQuantumLatency);
+		printf("events: %llu to the mixer, merged=%llu dropped=%llu\n", (unsigned long long)mixerEvents,
+			(unsigned long long)deviceStats.eventsMerged, (unsigned long long)deviceStats.eventsDropped);
+	}
+	printf("transport: %u jumps\n", context.transportJumps);
+	printf("heap allocations on real-time threads: %llu\n", (unsigned long long)realTimeAllocations);
+	printf("panel us: render p50=%.1f p99=%.1f, upload p50=%.1f p99=%.1f, timeouts=%llu dropped=%llu failed=%llu\n",
+		panelStats.render.p50Us, panelStats.render.p99Us, panelStats.upload.p50Us, panelStats.upload.p99Us,
+		(unsigned long long)panelStats.timeouts, (unsigned long long)panelStats.droppedBlocks,
+		(unsigned long long)panelStats.failedBlocks);
+	printf("panel waits: spin hits=%llu kernel=%llu\n", (unsigned long long)panelStats.spinHits, (unsigned long long)panelStats.kernelWaits);
+	printf("panel thread: %s%s, render workers: %i\n", MPTSchedulingClassName(schedulingClass), pinned ? ", pinned" : "", renderWorkers);
+	printf("memory: %.1f MiB locked (%.1f MiB huge pages), %.1f MiB prefaulted only\n", memoryStats.lockedBytes / 1048576.0,
+		memoryStats.hugePageBytes / 1048576.0, memoryStats.unlockedBytes / 1048576.0);
+	if(corruptBlocks) return 4;
+	if(realTimeAllocations) return 3;
+	return incompleteBlocks ? 2 : 0;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Command line
+ *
+ ******************************************************************************/
+
+static void PrintUsage(const char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --rate N           sample rate (44100)\n"
+		"  --frames N         frames per block (512)\n"
+		"  --max-buffer N     max buffer size announced by the mixer (frames)\n"
+		"  --channels N       stereo channels the panel serves, 0-%i (16)\n"
+		"  --blocks N         blocks to measure (20000)\n"
+		"  --warmup N         blocks to drive before measuring (200)\n"
+		"  --shm              use the shared-memory transport\n"
+		"  --float            negotiate float32 samples\n"
+		"  --packed N         send 24 or 16 bit samples through the pipe\n"
+		"  --render-ahead N   let the panel render N blocks ahead, needs --shm (0)\n"
+		"  --quantum N        let the panel render at least N frames per block (0)\n"
+		"  --realtime         pace blocks at the sample rate instead of back to back\n"
+		"  --burst N          with --realtime, deliver N blocks back to back, then pause for all of them (1)\n"
+		"  --no-spin          always sleep in the kernel when waiting for the other side\n"
+		"  --no-offline       keep the device from switching to throughput mode\n"
+		"  --rt               run the panel thread at real-time priority (SCHED_FIFO)\n"
+		"  --rr               like --rt, but SCHED_RR\n"
+		"  --affinity MASK    pin the panel thread to these CPUs, e.g. 0x4\n"
+		"  --workers N        render channel groups on N workers besides the panel thread\n"
+		"  --worker-affinity MASK  pin the workers to these CPUs, independently of --affinity\n"
+		"  --group N          stereo channels per group, 1-32 (4)\n"
+		"  --tempo-changes N  send N tempo changes per block and restart the song every 100 blocks\n"
+		"  --resize-every N   announce a bigger, then the original max buffer size every N blocks\n"
+		"  --buses N          sum the channels into N ReWire channels through a routing map, 1-%i\n",
+		program, kReWireAudioChannelCount / 2, MPT_ROUTING_MAX_BUSES);
+}
+
+int main(int argc, char *argv[])
+{
+	BenchOptions options;
+	for(int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const bool hasValue = (i + 1 < argc);
+		if(!strcmp(arg, "--rate") && hasValue) options.sampleRate = atoi(argv[++i]);
+		else if(!strcmp(arg, "--frames") && hasValue) options.framesToRender = atoi(argv[++i]);
+		else if(!strcmp(arg, "--max-buffer") && hasValue) options.maxBufferSize = atoi(argv[++i]);
+		else if(!strcmp(arg, "--channels") && hasValue) options.channels = atoi(argv[++i]);
+		else if(!strcmp(arg, "--blocks") && hasValue) options.blocks = atoi(argv[++i]);
+		else if(!strcmp(arg, "--warmup") && hasValue) options.warmupBlocks = atoi(argv[++i]);
+		else if(!strcmp(arg, "--render-ahead") && hasValue) options.renderAhead = atoi(argv[++i]);
+		else if(!strcmp(arg, "--quantum") && hasValue) options.renderQuantum = atoi(argv[++i]);
+		else if(!strcmp(arg, "--packed") && hasValue) options.packedBits = atoi(argv[++i]);
+		else if(!strcmp(arg, "--shm")) options.sharedMemory = true;
+		else if(!strcmp(arg, "--float")) options.float32 = true;
+		else if(!strcmp(arg, "--realtime")) options.realTime = true;
+		else if(!strcmp(arg, "--burst") && hasValue) options.burst = std::max(1, atoi(argv[++i]));
+		else if(!strcmp(arg, "--no-spin")) options.spinWait = false;
+		else if(!strcmp(arg, "--no-offline")) options.offlineDetection = false;
+		else if(!strcmp(arg, "--rt")) options.realTimeThread = true;
+		else if(!strcmp(arg, "--rr")) options.realTimeThread = options.roundRobin = true;
+		else if(!strcmp(arg, "--affinity") && hasValue) options.affinityMask = strtoull(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--workers") && hasValue) options.renderWorkers = atoi(argv[++i]);
+		else if(!strcmp(arg, "--worker-affinity") && hasValue) options.workerAffinityMask = strtoull(argv[++i], nullptr, 0);
+		else if(!strcmp(arg, "--group") && hasValue) options.channelsPerGroup = atoi(argv[++i]);
+		else if(!strcmp(arg, "--tempo-changes") && hasValue) options.tempoChanges = atoi(argv[++i]);
+		else if(!strcmp(arg, "--resize-every") && hasValue) options.resizeEvery = atoi(argv[++i]);
+		else if(!strcmp(arg, "--buses") && hasValue) options.buses = atoi(argv[++i]);
+		else
+		{
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(options.sampleRate <= 0 || options.framesToRender <= 0 || options.framesToRender > MPT_SHARED_RING_MAX_FRAMES
+		|| options.channels < 0 || options.channels > kReWireAudioChannelCount / 2 || options.blocks <= 0
+		|| (options.maxBufferSize && options.maxBufferSize < options.framesToRender)
+		|| (options.packedBits && 24 != options.packedBits && 16 != options.packedBits)
+		|| options.buses < 0 || options.buses > MPT_ROUTING_MAX_BUSES)
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	return RunBenchmark(options);
+}
@@ -0,0 +1,243 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "MPTRewireAudioKernels.h"
+
+// Checks every conversion kernel set the CPU can run bit for bit against the per-sample loops they replaced.
+// Frame counts around every vector width exercise the scalar tails, odd offsets the unaligned loads.
+// Exits non-zero on the first mismatch.
+
+#ifndef MIXING_SCALEF
+#define MIXING_SCALEF 134217728.0f
+#endif
+
+static const uint32_t g_FrameCounts[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 511, 1027, 4096 };
+static const int g_Offsets[] = { 0, 1, 3 };  // in samples, so that the vector loops see unaligned buffers
+#define MAX_FRAMES 4096
+#define MAX_OFFSET 3
+
+static int g_Failures = 0;
+
+#define CHECK(condition, ...) \
+	{ \
+		if(!(condition)) \
+		{ \
+			if(g_Failures++ < 20) { printf("  FAIL: "); printf(__VA_ARGS__); printf("\n"); } \
+		} \
+	}
+
+
+
+/*******************************************************************************
+ *
+ * Input
+ *
+ ******************************************************************************/
+
+static uint32_t g_Random = 0x12345678;
+
+static uint32_t NextRandom()
+{
+	g_Random ^= g_Random << 13;
+	g_Random ^= g_Random >> 17;
+	g_Random ^= g_Random << 5;
+	return g_Random;
+}
+
+// Full-scale noise with the extremes and the values around zero sprinkled in, rounding and saturation hide there
+static void FillInt32(int32_t *samples, size_t count)
+{
+	static const int32_t special[] = { INT32_MIN, INT32_MAX, -1, 0, 1, INT32_MIN + 1, INT32_MAX - 1,
+		0x7FFFF7, -0x800008, 7, 8, 9, -7, -8, -9, 0x3FFFFFF, -0x4000000 };
+	for(size_t i = 0; i < count; i++)
+	{
+		const uint32_t random = NextRandom();
+		if(0 == random % 4) samples[i] = special[(random >> 8) % (sizeof(special) / sizeof(special[0]))];
+		else if(1 == random % 4) samples[i] = (int32_t)NextRandom() >> 4;  // within MIXING_SCALEF's range
+		else samples[i] = (int32_t)NextRandom();
+	}
+}
+
+static bool SameBits(const float *a, const float *b, size_t count)
+{
+	return 0 == memcmp(a, b, count * sizeof(float));
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Reference loops
+ *
+ ******************************************************************************/
+
+// What UploadAudioChannelToMixer did per sample before there were kernels
+static void OriginalDeinterleave(const int32_t *src, float *outL, float *outR, uint32_t frames, float divisor)
+{
+	for(uint32_t s = 0; s < frames; s++)
+	{
+		*outL++ = static_cast<float>(*src++) / divisor;
+		*outR++ = static_cast<float>(*src++) / divisor;
+	}
+}
+
+// Rounds half up, then saturates
+static int32_t ReferenceInt24(int32_t sample)
+{
+	double value = floor((double)sample / (1 << (MPT_PACK_FRACTIONAL_BITS - 23)) + 0.5);
+	if(value > 8388607.0) value = 8388607.0;
+	if(value < -8388608.0) value = -8388608.0;
+	return (int32_t)value;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Tests
+ *
+ ******************************************************************************/
+
+static void TestDeinterleave(const MPTAudioKernels &kernels)
+{
+	std::vector<int32_t> input(2 * MAX_FRAMES + MAX_OFFSET);
+	std::vector<float> expectedL(MAX_FRAMES), expectedR(MAX_FRAMES), actualL(MAX_FRAMES + MAX_OFFSET), actualR(MAX_FRAMES + MAX_OFFSET);
+	for(uint32_t frames : g_FrameCounts)
+	{
+		for(int offset : g_Offsets)
+		{
+			const int32_t *src = input.data() + offset;
+			FillInt32(input.data(), input.size());
+
+			OriginalDeinterleave(src, expectedL.data(), expectedR.data(), frames, MIXING_SCALEF);
+			kernels.deinterleaveInt32(src, actualL.data() + offset, actualR.data() + offset, frames, 1.0f / MIXING_SCALEF);
+			CHECK(SameBits(expectedL.data(), actualL.data() + offset, frames) && SameBits(expectedR.data(), actualR.data() + offset, frames),
+				"deinterleaveInt32, %u frames at offset %i", frames, offset);
+
+			// Float samples are only moved, their bits must not change; the random input includes NaNs and denormals
+			const float *floatSrc = reinterpret_cast<const float *>(src);
+			for(uint32_t s = 0; s < frames; s++)
+			{
+				memcpy(&expectedL[s], &floatSrc[2 * s], sizeof(float));
+				memcpy(&expectedR[s], &floatSrc[2 * s + 1], sizeof(float));
+			}
+			kernels.deinterleaveFloat32(floatSrc, actualL.data() + offset, actualR.data() + offset, frames);
+			CHECK(SameBits(expectedL.data(), actualL.data() + offset, frames) && SameBits(expectedR.data(), actualR.data() + offset, frames),
+				"deinterleaveFloat32, %u frames at offset %i", frames, offset);
+		}
+	}
+}
+
+static void TestIsSilent(const MPTAudioKernels &kernels)
+{
+	std::vector<uint32_t> samples(2 * 64 + MAX_OFFSET);
+	for(size_t count = 0; count <= 2 * 64; count++)
+	{
+		for(int offset : g_Offsets)
+		{
+			uint32_t *src = samples.data() + offset;
+			memset(samples.data(), 0, samples.size() * sizeof(uint32_t));
+			CHECK(kernels.isSilent(src, count), "isSilent, %zu zero samples at offset %i", count, offset);
+
+			// A single set bit anywhere, the lowest one of a float's mantissa included
+			for(size_t i = 0; i < count; i++)
+			{
+				src[i] = (i % 2) ? 1u : 0x80000000u;
+				CHECK(!kernels.isSilent(src, count), "isSilent, %zu samples with sample %zu set at offset %i", count, i, offset);
+				src[i] = 0;
+			}
+		}
+	}
+}
+
+static void TestPacking(const MPTAudioKernels &kernels, const MPTAudioKernels &scalar)
+{
+	std::vector<int32_t> input(2 * MAX_FRAMES + MAX_OFFSET), inPlace(2 * MAX_FRAMES + MAX_OFFSET);
+	std::vector<uint8_t> expected(2 * MAX_FRAMES * 3), actual(2 * MAX_FRAMES * 3 + MAX_OFFSET * 4);
+	std::vector<float> expectedL(MAX_FRAMES), expectedR(MAX_FRAMES), actualL(MAX_FRAMES), actualR(MAX_FRAMES);
+	for(uint32_t frames : g_FrameCounts)
+	{
+		const size_t count = (size_t)frames * 2;
+		for(int offset : g_Offsets)
+		{
+			const int32_t *src = input.data() + offset;
+			FillInt32(input.data(), input.size());
+
+			// 24 bit, against the rounding spelled out, then unpacked again against the original division
+			for(size_t i = 0; i < count; i++)
+			{
+				const int32_t sample = ReferenceInt24(src[i]);
+				expected[i * 3] = (uint8_t)sample;
+				expected[i * 3 + 1] = (uint8_t)(sample >> 8);
+				expected[i * 3 + 2] = (uint8_t)(sample >> 16);
+			}
+			kernels.packInt24(src, actual.data() + offset, count);
+			CHECK(0 == memcmp(expected.data(), actual.data() + offset, count * 3), "packInt24, %u frames at offset %i", frames, offset);
+
+			memcpy(inPlace.data(), input.data(), input.size() * sizeof(int32_t));
+			uint8_t *packed = reinterpret_cast<uint8_t *>(inPlace.data() + offset);
+			kernels.packInt24(inPlace.data() + offset, packed, count);
+			CHECK(0 == memcmp(expected.data(), packed, count * 3), "packInt24 in place, %u frames at offset %i", frames, offset);
+
+			std::vector<int32_t> unpacked(count);
+			for(size_t i = 0; i < count; i++) unpacked[i] = ReferenceInt24(src[i]);
+			OriginalDeinterleave(unpacked.data(), expectedL.data(), expectedR.data(), frames, MPT_INT24_SCALEF);
+			kernels.deinterleaveInt24(packed, actualL.data(), actualR.data(), frames, 1.0f / MPT_INT24_SCALEF);
+			CHECK(SameBits(expectedL.data(), actualL.data(), frames) && SameBits(expectedR.data(), actualR.data(), frames),
+				"deinterleaveInt24, %u frames at offset %i", frames, offset);
+
+			// 16 bit, against the scalar kernel: the dither sequence is part of the output
+			uint32_t ditherExpected[MPT_DITHER_LANES], ditherActual[MPT_DITHER_LANES], ditherInPlace[MPT_DITHER_LANES];
+			for(int lane = 0; lane < MPT_DITHER_LANES; lane++)
+				ditherExpected[lane] = ditherActual[lane] = ditherInPlace[lane] = 0x9E3779B9u * (uint32_t)(lane + 1) + frames;
+			scalar.packInt16(src, expected.data(), count, ditherExpected);
+			kernels.packInt16(src, actual.data() + offset, count, ditherActual);
+			CHECK(0 == memcmp(expected.data(), actual.data() + offset, count * 2) && 0 == memcmp(ditherExpected, ditherActual, sizeof(ditherActual)),
+				"packInt16, %u frames at offset %i", frames, offset);
+
+			memcpy(inPlace.data(), input.data(), input.size() * sizeof(int32_t));
+			kernels.packInt16(inPlace.data() + offset, packed, count, ditherInPlace);
+			CHECK(0 == memcmp(expected.data(), packed, count * 2) && 0 == memcmp(ditherExpected, ditherInPlace, sizeof(ditherInPlace)),
+				"packInt16 in place, %u frames at offset %i", frames, offset);
+
+			const int16_t *samples16 = reinterpret_cast<const int16_t *>(expected.data());
+			for(size_t i = 0; i < count; i++) unpacked[i] = samples16[i];
+			OriginalDeinterleave(unpacked.data(), expectedL.data(), expectedR.data(), frames, MPT_INT16_SCALEF);
+			kernels.deinterleaveInt16(reinterpret_cast<const int16_t *>(packed), actualL.data(), actualR.data(), frames, 1.0f / MPT_INT16_SCALEF);
+			CHECK(SameBits(expectedL.data(), actualL.data(), frames) && SameBits(expectedR.data(), actualR.data(), frames),
+				"deinterleaveInt16, %u frames at offset %i", frames, offset);
+		}
+	}
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Main
+ *
+ ******************************************************************************/
+
+int main()
+{
+	const MPTAudioKernels *kernels[8];
+	const int kernelCount = MPTGetAvailableAudioKernels(kernels, 8);
+	const MPTAudioKernels &scalar = MPTGetScalarAudioKernels();
+
+	printf("dispatched kernels: %s\n", MPTGetAudioKernels().name);
+	for(int k = 0; k < kernelCount; k++)
+	{
+		const int failuresBefore = g_Failures;
+		printf("%s\n", kernels[k]->name);
+		TestDeinterleave(*kernels[k]);
+		TestIsSilent(*kernels[k]);
+		TestPacking(*kernels[k], scalar);
+		printf("  %s\n", g_Failures == failuresBefore ? "bit-exact" : "MISMATCH");
+	}
+	return g_Failures ? 1 : 0;
+}
@@ -0,0 +1,383 @@
+#include <Windows.h>
+#include <ReWireDeviceAPI.h>
+#include <ReWirePanelAPI.h>
+#include "MPTRewireWait.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// In-process stand-in for the ReWire runtime and the Win32 events, so that device and panel can talk
+// to each other inside a single benchmark executable. Pipes copy every message, just like the real thing.
+
+using namespace ReWire;
+
+
+
+/*******************************************************************************
+ *
+ * Events
+ *
+ ******************************************************************************/
+
+typedef struct
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool signaled = false;
+	bool manualReset = false;
+	int refCount = 0;
+	std::string name;
+} MockEvent;
+
+static std::mutex g_EventsMutex;
+static std::map<std::string, MockEvent *> g_Events;
+static thread_local DWORD g_LastError = 0;
+
+
+HANDLE CreateEventA(void *, BOOL manualReset, BOOL initialState, const char *name)
+{
+	std::lock_guard<std::mutex> lock(g_EventsMutex);
+	MockEvent *event = nullptr;
+	if(name)
+	{
+		auto it = g_Events.find(name);
+		if(it != g_Events.end()) event = it->second;
+	}
+	if(!event)
+	{
+		event = new MockEvent();
+		event->manualReset = (FALSE != manualReset);
+		event->signaled = (FALSE != initialState);
+		if(name)
+		{
+			event->name = name;
+			g_Events[name] = event;
+		}
+	}
+	event->refCount++;
+	return event;
+}
+
+HANDLE OpenEventA(DWORD, BOOL, const char *name)
+{
+	std::lock_guard<std::mutex> lock(g_EventsMutex);
+	auto it = g_Events.find(name ? name : "");
+	if(it == g_Events.end())
+	{
+		g_LastError = 2;  // ERROR_FILE_NOT_FOUND
+		return NULL;
+	}
+	it->second->refCount++;
+	return it->second;
+}
+
+BOOL SetEvent(HANDLE handle)
+{
+	MockEvent *event = static_cast<MockEvent *>(handle);
+	if(!event) return FALSE;
+	{
+		std::lock_guard<std::mutex> lock(event->mutex);
+		event->signaled = true;
+	}
+	event->condition.notify_all();
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE handle)
+{
+	MockEvent *event = static_cast<MockEvent *>(handle);
+	if(!event) return FALSE;
+	std::lock_guard<std::mutex> lock(event->mutex);
+	event->signaled = false;
+	return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD milliseconds)
+{
+	MockEvent *event = static_cast<MockEvent *>(handle);
+	if(!event)
+	{
+		g_LastError = 6;  // ERROR_INVALID_HANDLE
+		return WAIT_FAILED;
+	}
+
+	std::unique_lock<std::mutex> lock(event->mutex);
+	auto isSignaled = [event] { return event->signaled; };
+	if(INFINITE == milliseconds)
+		event->condition.wait(lock, isSignaled);
+	else if(!event->condition.wait_for(lock, std::chrono::milliseconds(milliseconds), isSignaled))
+		return WAIT_TIMEOUT;
+
+	if(!event->manualReset) event->signaled = false;
+	return WAIT_OBJECT_0;
+}
+
+bool MPTSetNamedEvent(void *event)
+{
+	return FALSE != SetEvent(event);
+}
+
+MPTWaitResult MPTWaitForNamedEvent(void *event, uint32_t milliseconds)
+{
+	switch(WaitForSingleObject(event, milliseconds))
+	{
+		case WAIT_ABANDONED:
+		case WAIT_OBJECT_0:
+			return MPTWaitResult::Woken;
+		case WAIT_TIMEOUT:
+			return MPTWaitResult::Timeout;
+	}
+	return MPTWaitResult::Failed;
+}
+
+BOOL CloseHandle(HANDLE handle)
+{
+	MockEvent *event = static_cast<MockEvent *>(handle);
+	if(!event) return FALSE;
+
+	std::lock_guard<std::mutex> lock(g_EventsMutex);
+	if(0 == --event->refCount)
+	{
+		if(!event->name.empty()) g_Events.erase(event->name);
+		delete event;
+	}
+	return TRUE;
+}
+
+DWORD GetLastError()
+{
+	return g_LastError ? g_LastError : (DWORD)errno;
+}
+
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count)
+{
+	count->QuadPart = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency)
+{
+	frequency->QuadPart = 1000000000;
+	return TRUE;
+}
+
+
+
+
+/*******************************************************************************
+ *
+ * Communication ports
+ *
+ ******************************************************************************/
+
+// One direction of a pipe: a byte ring of length-prefixed messages, bounded like the real pipe buffer
+class MockPipeQueue
+{
+private:
+	std::vector<uint8_t> m_Buffer;
+	size_t m_ReadPos = 0;
+	size_t m_Used = 0;
+	std::mutex m_Mutex;
+
+	void copyIn(const uint8_t *data, size_t size)
+	{
+		size_t writePos = (m_ReadPos + m_Used) % m_Buffer.size();
+		size_t first = std::min(size, m_Buffer.size() - writePos);
+		memcpy(&m_Buffer[writePos], data, first);
+		memcpy(&m_Buffer[0], data + first, size - first);
+		m_Used += size;
+	}
+
+	void copyOut(uint8_t *data, size_t size)
+	{
+		size_t first = std::min(size, m_Buffer.size() - m_ReadPos);
+		memcpy(data, &m_Buffer[m_ReadPos], first);
+		memcpy(data + first, &m_Buffer[0], size - first);
+		m_ReadPos = (m_ReadPos + size) % m_Buffer.size();
+		m_Used -= size;
+	}
+
+public:
+	void resize(size_t bufferSize)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Buffer.assign(bufferSize + sizeof(ReWire_uint16_t), 0);
+		m_ReadPos = m_Used = 0;
+	}
+
+	ReWireError send(ReWire_uint16_t size, const ReWire_uint8_t *data)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if(m_Used + sizeof(size) + size > m_Buffer.size()) return kReWireError_BufferFull;
+		copyIn(reinterpret_cast<const uint8_t *>(&size), sizeof(size));
+		copyIn(data, size);
+		return kReWireError_NoError;
+	}
+
+	ReWireError read(ReWire_uint16_t *size, ReWire_uint8_t *data)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if(0 == m_Used) return kReWireError_NoMoreMessages;
+		copyOut(reinterpret_cast<uint8_t *>(size), sizeof(*size));
+		copyOut(data, *size);
+		return kReWireError_NoError;
+	}
+};
+
+typedef struct
+{
+	MockPipeQueue toPanel;
+	MockPipeQueue toDevice;
+} MockPipe;
+
+typedef struct
+{
+	std::string signature;
+	std::vector<MockPipe> pipes;
+	std::atomic<bool> panelConnected{false};
+} MockPort;
+
+static std::mutex g_PortsMutex;
+static std::map<std::string, MockPort *> g_Ports;
+static bool g_DeviceOpen = false;
+static bool g_PanelOpen = false;
+
+
+ReWireError ReWire::RWDOpen()
+{
+	if(g_DeviceOpen) return kReWireImplError_ReWireAlreadyOpen;
+	g_DeviceOpen = true;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWDClose()
+{
+	g_DeviceOpen = false;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWDComCreate(const ReWire_char_t *signature, ReWire_uint32_t pipeCount, const ReWirePipeInfo *pipeInfo, TRWDPortHandle *portHandle)
+{
+	std::lock_guard<std::mutex> lock(g_PortsMutex);
+	if(g_Ports.count(signature)) return kReWireError_AlreadyExists;
+
+	MockPort *port = new MockPort();
+	port->signature = signature;
+	port->pipes = std::vector<MockPipe>(pipeCount);
+	for(ReWire_uint32_t i = 0; i < pipeCount; i++)
+	{
+		port->pipes[i].toPanel.resize(pipeInfo[i].fBufferSize);
+		port->pipes[i].toDevice.resize(pipeInfo[i].fBufferSize);
+	}
+	g_Ports[signature] = port;
+	*portHandle = port;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWDComDestroy(TRWDPortHandle portHandle)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	std::lock_guard<std::mutex> lock(g_PortsMutex);
+	g_Ports.erase(port->signature);
+	delete port;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWDComCheckConnection(TRWDPortHandle portHandle)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	return (port && port->panelConnected) ? kReWireError_PortConnected : kReWireError_PortNotConnected;
+}
+
+ReWireError ReWire::RWDComSend(TRWDPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t size, const ReWire_uint8_t *data)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	if(!port || pipe >= port->pipes.size()) return kReWireImplError_InvalidParameter;
+	if(!port->panelConnected) return kReWireError_PortNotConnected;
+	return port->pipes[pipe].toPanel.send(size, data);
+}
+
+ReWireError ReWire::RWDComRead(TRWDPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t *size, ReWire_uint8_t *data)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	if(!port || pipe >= port->pipes.size()) return kReWireImplError_InvalidParameter;
+	return port->pipes[pipe].toDevice.read(size, data);
+}
+
+
+ReWireError ReWire::RWPOpen()
+{
+	if(g_PanelOpen) return kReWireImplError_ReWireAlreadyOpen;
+	g_PanelOpen = true;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWPClose()
+{
+	g_PanelOpen = false;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWPIsCloseOK(ReWire_char_t *okFlag)
+{
+	*okFlag = 1;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWPRegisterReWireDevice(const ReWire_char_t *) { return kReWireError_NoError; }
+ReWireError ReWire::RWPUnregisterReWireDevice(const ReWire_char_t *) { return kReWireError_NoError; }
+
+ReWireError ReWire::RWPIsReWireMixerAppRunning(ReWire_char_t *isRunning)
+{
+	*isRunning = g_DeviceOpen ? 1 : 0;
+	return kReWireError_NoError;
+}
+
+// The benchmark opens the device itself, standing in for the mixer
+ReWireError ReWire::RWPLoadDevice(const ReWire_char_t *) { return g_DeviceOpen ? kReWireError_NoError : kReWireError_UnableToOpenDevice; }
+ReWireError ReWire::RWPUnloadDevice(const ReWire_char_t *) { return kReWireError_NoError; }
+
+ReWireError ReWire::RWPComConnect(const ReWire_char_t *signature, TRWPPortHandle *portHandle)
+{
+	std::lock_guard<std::mutex> lock(g_PortsMutex);
+	auto it = g_Ports.find(signature);
+	if(it == g_Ports.end()) return kReWireError_PortNotConnected;
+	if(it->second->panelConnected) return kReWireError_Busy;
+	it->second->panelConnected = true;
+	*portHandle = it->second;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWPComDisconnect(TRWPPortHandle portHandle)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	if(!port) return kReWireImplError_InvalidParameter;
+	port->panelConnected = false;
+	return kReWireError_NoError;
+}
+
+ReWireError ReWire::RWPComCheckConnection(TRWPPortHandle portHandle)
+{
+	return RWDComCheckConnection(portHandle);
+}
+
+ReWireError ReWire::RWPComSend(TRWPPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t size, const ReWire_uint8_t *data)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	if(!port || pipe >= port->pipes.size()) return kReWireImplError_InvalidParameter;
+	return port->pipes[pipe].toDevice.send(size, data);
+}
+
+ReWireError ReWire::RWPComRead(TRWPPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t *size, ReWire_uint8_t *data)
+{
+	MockPort *port = static_cast<MockPort *>(portHandle);
+	if(!port || pipe >= port->pipes.size()) return kReWireImplError_InvalidParameter;
+	return port->pipes[pipe].toPanel.read(size, data);
+}
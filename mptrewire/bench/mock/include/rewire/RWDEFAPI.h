@@ -0,0 +1,17 @@
+#pragma once
+#include "ReWire.h"
+
+// Entry points the mixer calls in the device; the benchmark calls them directly
+using namespace ReWire;
+
+void RWDEFGetDeviceNameAndVersion(ReWire_int32_t *codedForReWireVersion, ReWire_char_t *name);
+void RWDEFGetDeviceInfo(ReWireDeviceInfo *info);
+ReWireError RWDEFOpenDevice(const ReWireOpenInfo *openInfo);
+ReWire_char_t RWDEFIsCloseOK();
+void RWDEFCloseDevice();
+void RWDEFDriveAudio(const ReWireDriveAudioInputParams *inputParams, ReWireDriveAudioOutputParams *outputParams);
+void RWDEFSetAudioInfo(const ReWireAudioInfo *audioInfo);
+void RWDEFIdle();
+ReWireError RWDEFLaunchPanelApp();
+char RWDEFIsPanelAppLaunched();
+ReWireError RWDEFQuitPanelApp();
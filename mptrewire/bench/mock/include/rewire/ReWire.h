@@ -0,0 +1,180 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Just enough of the ReWire SDK for the loopback benchmark. Layouts do not match the real SDK.
+
+namespace ReWire {
+
+typedef int32_t ReWire_int32_t;
+typedef uint32_t ReWire_uint32_t;
+typedef int16_t ReWire_int16_t;
+typedef uint16_t ReWire_uint16_t;
+typedef uint8_t ReWire_uint8_t;
+typedef char ReWire_char_t;
+typedef int32_t ReWireError;
+typedef void *TRWDPortHandle;
+typedef void *TRWPPortHandle;
+
+enum
+{
+	kReWireError_NoError = 0,
+	kReWireError_PortNotConnected,
+	kReWireError_BufferFull,
+	kReWireError_PortStale,
+	kReWireError_PortConnected,
+	kReWireError_NoMoreMessages,
+	kReWireError_UnableToOpenDevice,
+	kReWireError_AlreadyExists,
+	kReWireError_Busy,
+	kReWireImplError_InvalidParameter = 100,
+	kReWireImplError_ReWireAlreadyOpen,
+	kReWireImplError_ReWireNotOpen,
+};
+
+#define kReWireAudioChannelCount 128
+#define REWIRE_BITFIELD_SIZE(bits) (((bits) + 31) / 32)
+#define REWIRE_DEVICE_DLL_API_VERSION 0x0200
+
+inline void ReWireSetBitInBitField(ReWire_uint32_t *bitField, ReWire_uint16_t bit) { bitField[bit >> 5] |= 1u << (bit & 31); }
+inline void ReWireClearBitInBitField(ReWire_uint32_t *bitField, ReWire_uint16_t bit) { bitField[bit >> 5] &= ~(1u << (bit & 31)); }
+inline int ReWireIsBitInBitFieldSet(const ReWire_uint32_t *bitField, ReWire_uint16_t bit) { return (bitField[bit >> 5] >> (bit & 31)) & 1; }
+inline void ReWireClearBitField(ReWire_uint32_t *bitField, ReWire_uint16_t bitCount) { memset(bitField, 0, REWIRE_BITFIELD_SIZE(bitCount) * sizeof(ReWire_uint32_t)); }
+
+
+typedef struct
+{
+	ReWire_int32_t fSampleRate;
+	ReWire_int32_t fMaxBufferSize;
+} ReWireAudioInfo;
+
+typedef struct
+{
+	ReWireAudioInfo fAudioInfo;
+} ReWireOpenInfo;
+
+typedef struct
+{
+	ReWire_uint32_t fBufferSize;
+	ReWire_uint32_t fMessageSize;
+} ReWirePipeInfo;
+
+inline void ReWirePreparePipeInfo(ReWirePipeInfo *pipeInfo, ReWire_uint32_t bufferSize, ReWire_uint32_t messageSize) {
+	pipeInfo->fBufferSize = bufferSize;
+	pipeInfo->fMessageSize = messageSize;
+}
+inline void ReWirePrepareAudioInfo(ReWireAudioInfo *audioInfo, ReWire_int32_t sampleRate, ReWire_int32_t maxBufferSize) {
+	audioInfo->fSampleRate = sampleRate;
+	audioInfo->fMaxBufferSize = maxBufferSize;
+}
+inline void ReWirePrepareOpenInfo(ReWireOpenInfo *openInfo, ReWire_int32_t sampleRate, ReWire_int32_t maxBufferSize) {
+	ReWirePrepareAudioInfo(&openInfo->fAudioInfo, sampleRate, maxBufferSize);
+}
+
+typedef struct
+{
+	ReWire_int32_t fCodedForReWireVersion;
+	ReWire_char_t fName[32];
+	ReWire_int32_t fChannelCount;
+	ReWire_char_t fChannelNames[kReWireAudioChannelCount][32];
+	ReWire_uint32_t fStereoPairsBitField[REWIRE_BITFIELD_SIZE(kReWireAudioChannelCount)];
+	ReWire_uint32_t fMaxEventOutputBufferSize;
+} ReWireDeviceInfo;
+
+
+/*******************************************************************************
+ *
+ * Events
+ *
+ ******************************************************************************/
+
+enum
+{
+	kReWireRequestPlayEvent = 10,
+	kReWireRequestStopEvent,
+	kReWireRequestTempoEvent,
+	kReWireRequestRepositionEvent,
+	kReWireRequestLoopEvent,
+	kReWireRequestSignatureEvent,
+};
+
+typedef struct
+{
+	ReWire_uint16_t fEventType;
+	ReWire_uint8_t fData[30];
+} ReWireEvent;
+
+typedef struct
+{
+	ReWire_uint16_t fEventType;
+	ReWire_uint32_t fTempo;
+} ReWireRequestTempoEvent;
+
+typedef struct
+{
+	ReWire_uint16_t fEventType;
+	ReWire_int32_t fPPQ15360Pos;
+} ReWireRequestRepositionEvent;
+
+inline void ReWireConvertToRequestPlayEvent(ReWireEvent *event) { event->fEventType = kReWireRequestPlayEvent; }
+inline void ReWireConvertToRequestStopEvent(ReWireEvent *event) { event->fEventType = kReWireRequestStopEvent; }
+inline ReWireRequestTempoEvent *ReWireConvertToRequestTempoEvent(ReWireEvent *event) {
+	event->fEventType = kReWireRequestTempoEvent;
+	return reinterpret_cast<ReWireRequestTempoEvent *>(event);
+}
+inline ReWireRequestRepositionEvent *ReWireConvertToRequestRepositionEvent(ReWireEvent *event) {
+	event->fEventType = kReWireRequestRepositionEvent;
+	return reinterpret_cast<ReWireRequestRepositionEvent *>(event);
+}
+
+typedef struct
+{
+	ReWire_uint32_t fCount;
+	ReWire_uint32_t fEventBufferSize;
+	ReWireEvent *fEventBuffer;
+} ReWireEventBuffer;
+
+typedef struct { int fUnused; } ReWireEventInfo;
+typedef struct { int fUnused; } ReWireEventBusInfo;
+typedef struct { int fUnused; } ReWireEventTarget;
+typedef struct { int fUnused; } ReWireEventChannelInfo;
+typedef struct { int fUnused; } ReWireEventControllerInfo;
+typedef struct { int fUnused; } ReWireEventNoteInfo;
+
+
+/*******************************************************************************
+ *
+ * Audio
+ *
+ ******************************************************************************/
+
+enum
+{
+	kReWirePlayModeStopped = 0,
+	kReWirePlayModeNormal,
+	kReWirePlayModeChase,
+};
+
+typedef struct
+{
+	float **fAudioBuffers;
+	ReWire_uint32_t fRequestedChannelsBitField[REWIRE_BITFIELD_SIZE(kReWireAudioChannelCount)];
+	ReWire_uint32_t fFramesToRender;
+	ReWire_int32_t fPPQ15360TickOfBatchStart;
+	ReWire_uint32_t fTempo;               // BPM * 1000
+	ReWire_uint32_t fSignatureNumerator;
+	ReWire_uint32_t fSignatureDenominator;
+	ReWire_int32_t fLoopStartPPQ15360Pos;
+	ReWire_int32_t fLoopEndPPQ15360Pos;
+	ReWire_uint32_t fLoopOn;
+	ReWire_uint32_t fPlayMode;
+	ReWireEventBuffer fEventInBuffer;
+} ReWireDriveAudioInputParams;
+
+typedef struct
+{
+	ReWire_uint32_t fServedChannelsBitField[REWIRE_BITFIELD_SIZE(kReWireAudioChannelCount)];
+	ReWireEventBuffer fEventOutBuffer;
+} ReWireDriveAudioOutputParams;
+
+} // namespace ReWire
@@ -0,0 +1,14 @@
+#pragma once
+#include "ReWire.h"
+
+namespace ReWire {
+
+ReWireError RWDOpen();
+ReWireError RWDClose();
+ReWireError RWDComCreate(const ReWire_char_t *signature, ReWire_uint32_t pipeCount, const ReWirePipeInfo *pipeInfo, TRWDPortHandle *portHandle);
+ReWireError RWDComDestroy(TRWDPortHandle portHandle);
+ReWireError RWDComCheckConnection(TRWDPortHandle portHandle);
+ReWireError RWDComSend(TRWDPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t size, const ReWire_uint8_t *data);
+ReWireError RWDComRead(TRWDPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t *size, ReWire_uint8_t *data);
+
+} // namespace ReWire
@@ -0,0 +1,20 @@
+#pragma once
+#include "ReWire.h"
+
+namespace ReWire {
+
+ReWireError RWPOpen();
+ReWireError RWPClose();
+ReWireError RWPIsCloseOK(ReWire_char_t *okFlag);
+ReWireError RWPRegisterReWireDevice(const ReWire_char_t *path);
+ReWireError RWPUnregisterReWireDevice(const ReWire_char_t *path);
+ReWireError RWPIsReWireMixerAppRunning(ReWire_char_t *isRunning);
+ReWireError RWPLoadDevice(const ReWire_char_t *deviceName);
+ReWireError RWPUnloadDevice(const ReWire_char_t *deviceName);
+ReWireError RWPComConnect(const ReWire_char_t *signature, TRWPPortHandle *portHandle);
+ReWireError RWPComDisconnect(TRWPPortHandle portHandle);
+ReWireError RWPComCheckConnection(TRWPPortHandle portHandle);
+ReWireError RWPComSend(TRWPPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t size, const ReWire_uint8_t *data);
+ReWireError RWPComRead(TRWPPortHandle portHandle, ReWire_uint32_t pipe, ReWire_uint16_t *size, ReWire_uint8_t *data);
+
+} // namespace ReWire
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// The handful of Win32 calls the bridge makes, implemented on top of the C++ standard library in MockReWire.cpp
+
+typedef int BOOL;
+typedef unsigned long DWORD;
+typedef void *LPVOID;
+typedef void *HINSTANCE;
+typedef void *HANDLE;
+
+#define WINAPI
+#define TRUE  1
+#define FALSE 0
+#define MAX_PATH 260
+#define DLL_PROCESS_ATTACH 1
+
+#define SYNCHRONIZE    0x00100000L
+#define INFINITE       0xFFFFFFFF
+#define WAIT_OBJECT_0  0x00000000L
+#define WAIT_ABANDONED 0x00000080L
+#define WAIT_TIMEOUT   0x00000102L
+#define WAIT_FAILED    0xFFFFFFFF
+
+typedef union
+{
+	struct
+	{
+		uint32_t LowPart;
+		int32_t HighPart;
+	};
+	int64_t QuadPart;
+} LARGE_INTEGER;
+
+// Named auto- or manual-reset events, shared by everything in the process
+HANDLE CreateEventA(void *securityAttributes, BOOL manualReset, BOOL initialState, const char *name);
+HANDLE OpenEventA(DWORD desiredAccess, BOOL inheritHandle, const char *name);
+BOOL SetEvent(HANDLE event);
+BOOL ResetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE event, DWORD milliseconds);
+BOOL CloseHandle(HANDLE event);
+DWORD GetLastError();
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER *count);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *frequency);
+
+inline BOOL AllocConsole() { return TRUE; }
+inline DWORD GetModuleFileNameA(HINSTANCE, char *fileName, DWORD size) {
+	strncpy(fileName, "./OpenMPT.exe", size);
+	return (DWORD)strlen(fileName);
+}
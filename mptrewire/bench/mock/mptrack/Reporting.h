@@ -0,0 +1,7 @@
+#pragma once
+#include <stdio.h>
+
+namespace Reporting
+{
+	inline void Error(const char *text) { fprintf(stderr, "%s\n", text); }
+}